@@ -0,0 +1,349 @@
+#include "common/src/common/math.h"
+#include "common/src/common/parallel.h"
+#include "common/src/common/timing.h"
+#include "common/src/core/collision.h"
+#include "common/src/core/geometry.h"
+#include "common/src/core/tile_map.h"
+#include "common/src/managed/task_pool.h"
+#include <glm/glm.hpp>
+#include <improbable/worker.h>
+#include <schema/chunk.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace gloam {
+namespace benchmark {
+namespace {
+// Same as the master's default.
+const std::int32_t kChunkSize = 8;
+// Side lengths of the generated maps in chunks: roughly 1k, 16k, 256k and 1M tiles.
+const std::int32_t kMapSizes[] = {4, 16, 64, 128};
+// Total number of tiles to re-extract for each full update benchmark, to keep run times similar.
+const std::size_t kUpdateTiles = 1 << 22;
+const std::size_t kQueries = 1 << 17;
+const std::size_t kBatchSize = 256;
+const core::Box kPlayerBox{1.f / 8};
+
+enum class Terrain {
+  // Flat ground with nothing in the way.
+  kOpen,
+  // Random heights: mostly flat, with cliffs, raised blocks and ramps.
+  kRandom,
+  // Long corridors two tiles wide, with a gap in the walls every 16 tiles.
+  kCorridors,
+};
+
+std::string terrain_name(Terrain terrain) {
+  switch (terrain) {
+  case Terrain::kOpen:
+    return "open";
+  case Terrain::kRandom:
+    return "random";
+  case Terrain::kCorridors:
+    return "corridors";
+  }
+  return "";
+}
+
+schema::Tile generate_tile(Terrain terrain, const glm::ivec2& coords, std::mt19937& rng) {
+  auto flat = [](std::int32_t height) {
+    return schema::Tile{schema::Tile::Terrain::kGrass, height, schema::Tile::Ramp::kNone};
+  };
+
+  if (terrain == Terrain::kCorridors) {
+    bool wall = !common::euclidean_mod(coords.y, 3) && common::euclidean_mod(coords.x, 16);
+    return flat(wall ? 2 : 0);
+  }
+  if (terrain == Terrain::kOpen) {
+    return flat(0);
+  }
+
+  auto roll = rng() % 16;
+  if (roll < 10) {
+    return flat(0);
+  }
+  if (roll < 14) {
+    return flat(static_cast<std::int32_t>(1 + rng() % 3));
+  }
+  return {schema::Tile::Terrain::kGrass, static_cast<std::int32_t>(rng() % 2),
+          static_cast<schema::Tile::Ramp>(1 + rng() % 4)};
+}
+
+worker::List<schema::Tile> generate_chunk(Terrain terrain, const glm::ivec2& chunk_coords,
+                                          std::mt19937& rng) {
+  worker::List<schema::Tile> tiles;
+  for (std::int32_t y = 0; y < kChunkSize; ++y) {
+    for (std::int32_t x = 0; x < kChunkSize; ++x) {
+      tiles.push_back(generate_tile(terrain, kChunkSize * chunk_coords + glm::ivec2{x, y}, rng));
+    }
+  }
+  return tiles;
+}
+
+// A tile map filled in directly with generated chunks, centred on the origin.
+struct Map {
+  Map(Terrain terrain, std::int32_t size_chunks) : terrain{terrain}, size_chunks{size_chunks} {
+    std::mt19937 rng{1};
+    worker::EntityId entity_id = 1;
+    for (std::int32_t y = 0; y < size_chunks; ++y) {
+      for (std::int32_t x = 0; x < size_chunks; ++x) {
+        glm::ivec2 coords{x - size_chunks / 2, y - size_chunks / 2};
+        tile_map.add_chunk(entity_id++, {kChunkSize, coords.x, coords.y,
+                                         generate_chunk(terrain, coords, rng), {}});
+      }
+    }
+  }
+
+  std::size_t tiles() const {
+    return static_cast<std::size_t>(size_chunks * size_chunks * kChunkSize * kChunkSize);
+  }
+
+  // Half the side length of the map, in tiles.
+  float radius() const {
+    return static_cast<float>(size_chunks * kChunkSize / 2);
+  }
+
+  Terrain terrain;
+  std::int32_t size_chunks;
+  core::TileMap tile_map;
+};
+
+struct Result {
+  std::string name;
+  std::string terrain;
+  std::size_t tiles;
+  std::size_t iterations;
+  double ns_per_op;
+};
+
+template <typename F>
+double time_ns(std::size_t iterations, const F& f) {
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    f(i);
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+  return static_cast<double>(elapsed.count()) / static_cast<double>(iterations);
+}
+
+// Accumulates query results, so that the compiler can't throw the queries away.
+volatile float sink = 0.f;
+
+// Queries from random points on open ground, each moving a player's distance in a random
+// direction. Points are kept away from the edges of the map.
+struct Query {
+  glm::vec3 position;
+  glm::vec2 projection;
+};
+
+std::vector<Query> generate_queries(const Map& map, const core::Collision& collision,
+                                    std::mt19937& rng) {
+  std::uniform_real_distribution<float> coord{-map.radius() + 2.f, map.radius() - 2.f};
+  std::uniform_real_distribution<float> angle{0.f, 6.2831853f};
+  std::vector<Query> queries;
+  while (queries.size() < kQueries) {
+    glm::vec3 position{coord(rng), 0.f, coord(rng)};
+    auto tile = map.tile_map.tile(glm::ivec2{glm::floor(common::get_xz(position))});
+    if (!tile || tile->height() != 0 || tile->ramp() != schema::Tile::Ramp::kNone) {
+      continue;
+    }
+    position.y = collision.terrain_height(kPlayerBox, position);
+    auto a = angle(rng);
+    glm::vec2 direction{std::cos(a), std::sin(a)};
+    if (map.terrain == Terrain::kCorridors) {
+      // Mostly along the corridor, so that the player slides along the walls.
+      direction = glm::normalize(glm::vec2{direction.x < 0 ? -1.f : 1.f, direction.y / 2});
+    }
+    queries.push_back({position, common::kPlayerSpeed * direction});
+  }
+  return queries;
+}
+
+// Queries pushing diagonally into the corners where corridor walls meet the gaps between them.
+std::vector<Query> generate_corner_queries(const Map& map, std::mt19937& rng) {
+  auto gaps = static_cast<std::int32_t>(map.radius()) / 16;
+  auto rows = static_cast<std::int32_t>(map.radius()) / 3;
+  std::uniform_int_distribution<std::int32_t> gap{-gaps + 1, gaps - 1};
+  std::uniform_int_distribution<std::int32_t> row{-rows + 1, rows - 1};
+  std::uniform_real_distribution<float> offset{0.f, 1.f / 16};
+  std::vector<Query> queries;
+  while (queries.size() < kQueries) {
+    // Just inside the corridor, next to the end of a wall, heading into it.
+    glm::vec3 position{16.f * gap(rng) + 1.25f + offset(rng), 0.f,
+                       3.f * row(rng) + 1.f + 1.f / 8 + offset(rng)};
+    queries.push_back({position, common::kPlayerSpeed * glm::normalize(glm::vec2{1.f, -1.f})});
+  }
+  return queries;
+}
+
+void run_map(Terrain terrain, std::int32_t size_chunks, managed::TaskPool& pool,
+             std::vector<Result>& results) {
+  Map map{terrain, size_chunks};
+  auto name = terrain_name(terrain);
+  auto record = [&](const std::string& benchmark, std::size_t iterations, double ns) {
+    results.push_back({benchmark, name, map.tiles(), iterations, ns});
+    std::cout << "[info] " << benchmark << " (" << name << ", " << map.tiles()
+              << " tiles): " << ns << " ns/op" << std::endl;
+  };
+
+  // Full rebuild, as on worker startup.
+  auto update_iterations = std::max<std::size_t>(1, kUpdateTiles / map.tiles());
+  record("update_full", update_iterations, time_ns(update_iterations, [&](std::size_t) {
+           core::Collision collision{map.tile_map, &pool};
+           collision.update();
+         }));
+
+  core::Collision collision{map.tile_map, &pool};
+  collision.update();
+  std::mt19937 rng{2};
+
+  if (terrain == Terrain::kRandom) {
+    std::uniform_real_distribution<float> coord{-map.radius(), map.radius()};
+    std::vector<glm::vec3> points;
+    for (std::size_t i = 0; i < kQueries; ++i) {
+      points.push_back({coord(rng), 4.f, coord(rng)});
+    }
+    record("terrain_height", kQueries, time_ns(kQueries, [&](std::size_t i) {
+             sink += collision.terrain_height(kPlayerBox, points[i]);
+           }));
+    record("terrain_height_point", kQueries, time_ns(kQueries, [&](std::size_t i) {
+             sink += collision.terrain_height(points[i]);
+           }));
+    record("corner_heights", kQueries, time_ns(kQueries, [&](std::size_t i) {
+             sink += collision.corner_heights(kPlayerBox, points[i])[0];
+           }));
+  }
+
+  auto queries = generate_queries(map, collision, rng);
+  auto project_name = terrain == Terrain::kOpen ? "project_xz_open_field"
+                                                : terrain == Terrain::kCorridors
+          ? "project_xz_corridor"
+          : "project_xz_random";
+  record(project_name, kQueries, time_ns(kQueries, [&](std::size_t i) {
+           sink += collision.project_xz(kPlayerBox, queries[i].position, queries[i].projection).x;
+         }));
+
+  // The same queries in batches, as the ambient worker makes them.
+  std::vector<core::Box> boxes(kBatchSize, kPlayerBox);
+  std::vector<glm::vec3> positions(kBatchSize);
+  std::vector<glm::vec2> projections(kBatchSize);
+  std::vector<glm::vec2> batch_results(kBatchSize);
+  core::Collision::Context context;
+  // Reported per query rather than per batch, for comparison with the unbatched version.
+  auto batches = kQueries / kBatchSize;
+  record(std::string{project_name} + "_batch", kQueries,
+         time_ns(batches, [&](std::size_t i) {
+           for (std::size_t j = 0; j < kBatchSize; ++j) {
+             positions[j] = queries[i * kBatchSize + j].position;
+             projections[j] = queries[i * kBatchSize + j].projection;
+           }
+           collision.project_xz(kBatchSize, boxes.data(), positions.data(), projections.data(),
+                                batch_results.data(), context);
+           sink += batch_results.front().x;
+         }) / kBatchSize);
+
+  // A single player walking with a cache, as the client does.
+  core::Collision::Cache cache;
+  auto position = queries.front().position;
+  record(std::string{project_name} + "_cached", kQueries, time_ns(kQueries, [&](std::size_t i) {
+           auto projection =
+               collision.project_xz(kPlayerBox, position, queries[i].projection, cache);
+           position += common::from_xz(projection, 0.f);
+           position.y = collision.terrain_height(kPlayerBox, position);
+           auto limit = map.radius() - 4.f;
+           if (std::abs(position.x) > limit || std::abs(position.z) > limit) {
+             position = queries[i].position;
+           }
+         }));
+
+  if (terrain == Terrain::kCorridors && map.radius() >= 32.f) {
+    auto corner_queries = generate_corner_queries(map, rng);
+    record("project_xz_corner_sliding", kQueries, time_ns(kQueries, [&](std::size_t i) {
+             const auto& query = corner_queries[i];
+             sink += collision.project_xz(kPlayerBox, query.position, query.projection).x;
+           }));
+  }
+
+  // Incremental update after a single chunk changes. This modifies the map, so it goes last.
+  std::uniform_int_distribution<worker::EntityId> entity{1, size_chunks * size_chunks};
+  std::vector<worker::List<schema::Tile>> chunk_tiles;
+  for (std::size_t i = 0; i < 16; ++i) {
+    chunk_tiles.push_back(generate_chunk(Terrain::kRandom, {0, 0}, rng));
+  }
+  const std::size_t kIncrementalUpdates = 1024;
+  record("update_incremental", kIncrementalUpdates,
+         time_ns(kIncrementalUpdates, [&](std::size_t i) {
+           map.tile_map.update_chunk(
+               entity(rng), schema::Chunk::Update{}.set_tiles(chunk_tiles[i % chunk_tiles.size()]));
+           collision.update();
+         }));
+
+  // Incremental update after a single tile is patched.
+  std::uniform_int_distribution<std::uint32_t> tile_index{0, kChunkSize * kChunkSize - 1};
+  record("update_patch", kIncrementalUpdates, time_ns(kIncrementalUpdates, [&](std::size_t i) {
+           worker::List<schema::TilePatch> patches;
+           const auto& tiles = chunk_tiles[i % chunk_tiles.size()];
+           patches.emplace_back(tile_index(rng), tiles[tile_index(rng)]);
+           map.tile_map.update_chunk(
+               entity(rng), schema::Chunk::Update{}.add_patch(schema::TilePatches{patches}));
+           collision.update();
+         }));
+}
+
+std::string to_json(const std::vector<Result>& results) {
+  std::ostringstream json;
+  json << "{\n  \"benchmarks\": [";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& result = results[i];
+    json << (i ? ",\n" : "\n") << "    {\"name\": \"" << result.name << "\", \"terrain\": \""
+         << result.terrain << "\", \"tiles\": " << result.tiles
+         << ", \"iterations\": " << result.iterations << ", \"ns_per_op\": " << result.ns_per_op
+         << "}";
+  }
+  json << "\n  ]\n}\n";
+  return json.str();
+}
+
+}  // anonymous
+}  // ::benchmark
+}  // ::gloam
+
+int main(int argc, char** argv) {
+  if (argc > 2) {
+    std::cerr << "[error] Usage: " << argv[0] << " [output/path.json]" << std::endl;
+    return 1;
+  }
+
+  using gloam::benchmark::Terrain;
+  std::vector<gloam::benchmark::Result> results;
+  // Shared by every Collision, as a worker would share one pool between its tile maps.
+  gloam::managed::TaskPool pool{gloam::common::hardware_threads()};
+  for (auto size_chunks : gloam::benchmark::kMapSizes) {
+    for (auto terrain : {Terrain::kOpen, Terrain::kRandom, Terrain::kCorridors}) {
+      gloam::benchmark::run_map(terrain, size_chunks, pool, results);
+    }
+  }
+
+  auto json = gloam::benchmark::to_json(results);
+  if (argc == 2) {
+    std::ofstream output{argv[1]};
+    output << json;
+    if (!output) {
+      std::cerr << "[error] Couldn't write " << argv[1] << "." << std::endl;
+      return 1;
+    }
+    std::cout << "[info] Wrote " << argv[1] << "." << std::endl;
+  } else {
+    std::cout << json;
+  }
+  return 0;
+}
@@ -0,0 +1,139 @@
+#ifndef GLOAM_COMMON_SRC_COMMON_CHUNK_GEOMETRY_H
+#define GLOAM_COMMON_SRC_COMMON_CHUNK_GEOMETRY_H
+#include "common/src/common/math.h"
+#include <glm/vec2.hpp>
+#include <cstddef>
+#include <cstdint>
+
+namespace gloam {
+namespace common {
+namespace detail {
+
+constexpr std::int32_t log2(std::int32_t n) {
+  return n > 1 ? 1 + log2(n / 2) : 0;
+}
+
+}  // ::detail
+
+// Conversions between tile, chunk and chunk-local coordinates for chunks of side N tiles, with
+// local tiles indexed by row and then column. For power-of-two N these are all shifts and masks.
+// This relies on right shifts of negative numbers being arithmetic, as on every supported compiler.
+template <std::int32_t N>
+class ChunkGeometry {
+public:
+  static_assert(N > 0 && !(N & (N - 1)), "chunk size must be a power of two");
+  static constexpr std::int32_t kShift = detail::log2(N);
+  static constexpr std::int32_t kMask = N - 1;
+
+  std::int32_t size() const {
+    return N;
+  }
+
+  glm::ivec2 chunk_coords(const glm::ivec2& tile) const {
+    return {tile.x >> kShift, tile.y >> kShift};
+  }
+
+  glm::ivec2 local_coords(const glm::ivec2& tile) const {
+    return {tile.x & kMask, tile.y & kMask};
+  }
+
+  std::size_t tile_index(const glm::ivec2& local) const {
+    return static_cast<std::size_t>(local.y << kShift | local.x);
+  }
+
+  glm::ivec2 tile_coords(const glm::ivec2& chunk, std::size_t tile_index) const {
+    auto index = static_cast<std::int32_t>(tile_index);
+    return {N * chunk.x + (index & kMask), N * chunk.y + (index >> kShift)};
+  }
+};
+
+template <std::int32_t N>
+constexpr std::int32_t ChunkGeometry<N>::kShift;
+template <std::int32_t N>
+constexpr std::int32_t ChunkGeometry<N>::kMask;
+
+// Fallback for any other (positive) chunk size.
+template <>
+class ChunkGeometry<0> {
+public:
+  explicit ChunkGeometry(std::int32_t size) : size_{size} {}
+
+  std::int32_t size() const {
+    return size_;
+  }
+
+  glm::ivec2 chunk_coords(const glm::ivec2& tile) const {
+    return {euclidean_div(tile.x, size_), euclidean_div(tile.y, size_)};
+  }
+
+  glm::ivec2 local_coords(const glm::ivec2& tile) const {
+    return {euclidean_mod(tile.x, size_), euclidean_mod(tile.y, size_)};
+  }
+
+  std::size_t tile_index(const glm::ivec2& local) const {
+    return static_cast<std::size_t>(local.y * size_ + local.x);
+  }
+
+  glm::ivec2 tile_coords(const glm::ivec2& chunk, std::size_t tile_index) const {
+    auto index = static_cast<std::int32_t>(tile_index);
+    return {size_ * chunk.x + index % size_, size_ * chunk.y + index / size_};
+  }
+
+private:
+  std::int32_t size_;
+};
+
+// Calls f with the ChunkGeometry specialized for the given chunk size if there is one, or the
+// runtime fallback otherwise. The function object needs a templated operator() taking any
+// ChunkGeometry.
+template <typename F>
+auto with_chunk_geometry(std::int32_t size, const F& f) -> decltype(f(ChunkGeometry<0>{size})) {
+  switch (size) {
+  case 8:
+    return f(ChunkGeometry<8>{});
+  case 16:
+    return f(ChunkGeometry<16>{});
+  case 32:
+    return f(ChunkGeometry<32>{});
+  case 64:
+    return f(ChunkGeometry<64>{});
+  default:
+    return f(ChunkGeometry<0>{size});
+  }
+}
+
+namespace detail {
+
+struct ChunkCoords {
+  template <typename Geometry>
+  glm::ivec2 operator()(const Geometry& geometry) const {
+    return geometry.chunk_coords(tile);
+  }
+  const glm::ivec2& tile;
+};
+
+struct TileCoords {
+  template <typename Geometry>
+  glm::ivec2 operator()(const Geometry& geometry) const {
+    return geometry.tile_coords(chunk, tile_index);
+  }
+  const glm::ivec2& chunk;
+  std::size_t tile_index;
+};
+
+}  // ::detail
+
+// Chunk containing the given tile, for chunks of the given size.
+inline glm::ivec2 chunk_coords(std::int32_t size, const glm::ivec2& tile) {
+  return with_chunk_geometry(size, detail::ChunkCoords{tile});
+}
+
+// Coordinates of the tile at the given index within a chunk of the given size.
+inline glm::ivec2 tile_coords(std::int32_t size, const glm::ivec2& chunk, std::size_t tile_index) {
+  return with_chunk_geometry(size, detail::TileCoords{chunk, tile_index});
+}
+
+}  // ::common
+}  // ::gloam
+
+#endif
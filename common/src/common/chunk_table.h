@@ -0,0 +1,252 @@
+#ifndef GLOAM_COMMON_SRC_COMMON_CHUNK_TABLE_H
+#define GLOAM_COMMON_SRC_COMMON_CHUNK_TABLE_H
+#include <glm/common.hpp>
+#include <glm/vec2.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace gloam {
+namespace common {
+
+// Dense table of values keyed by chunk coordinate. Values live in a contiguous vector of slots,
+// and are looked up through a flat grid of slot indices covering the bounding box of the chunks,
+// so lookups are a bounds check and two array reads with no hashing. The grid grows as chunks are
+// inserted, and shrinks back once it's mostly empty, so a table following a moving working set
+// stays the size of that set rather than of everywhere it has been.
+template <typename T>
+class ChunkTable {
+public:
+  struct Slot {
+    glm::ivec2 coords;
+    bool occupied = false;
+    T value;
+  };
+
+  template <typename S, typename V>
+  class basic_iterator {
+  public:
+    basic_iterator(V* slots, std::size_t index, std::size_t end)
+    : slots_{slots}, index_{index}, end_{end} {
+      skip();
+    }
+
+    S& operator*() const {
+      return (*slots_)[index_];
+    }
+
+    S* operator->() const {
+      return &(*slots_)[index_];
+    }
+
+    basic_iterator& operator++() {
+      ++index_;
+      skip();
+      return *this;
+    }
+
+    bool operator==(const basic_iterator& other) const {
+      return index_ == other.index_;
+    }
+
+    bool operator!=(const basic_iterator& other) const {
+      return index_ != other.index_;
+    }
+
+  private:
+    void skip() {
+      while (index_ < end_ && !(*slots_)[index_].occupied) {
+        ++index_;
+      }
+    }
+
+    V* slots_;
+    std::size_t index_;
+    std::size_t end_;
+  };
+
+  using iterator = basic_iterator<Slot, std::vector<Slot>>;
+  using const_iterator = basic_iterator<const Slot, const std::vector<Slot>>;
+
+  // Iterate occupied slots in memory order.
+  iterator begin() {
+    return {&slots_, 0, slots_.size()};
+  }
+
+  iterator end() {
+    return {&slots_, slots_.size(), slots_.size()};
+  }
+
+  const_iterator begin() const {
+    return {&slots_, 0, slots_.size()};
+  }
+
+  const_iterator end() const {
+    return {&slots_, slots_.size(), slots_.size()};
+  }
+
+  bool empty() const {
+    return !size_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  // Heap memory held by the table itself, not counting anything the values point to.
+  std::size_t bytes() const {
+    return slots_.capacity() * sizeof(Slot) + (free_slots_.capacity() + grid_.capacity()) *
+        sizeof(std::int32_t);
+  }
+
+  // Index of the slot for the given chunk, or -1 if there is none.
+  std::int32_t slot_index(const glm::ivec2& coords) const {
+    auto v = coords - grid_min_;
+    if (v.x < 0 || v.y < 0 || v.x >= grid_size_.x || v.y >= grid_size_.y) {
+      return -1;
+    }
+    return grid_[v.y * grid_size_.x + v.x];
+  }
+
+  const Slot& slot(std::int32_t index) const {
+    return slots_[index];
+  }
+
+  T* find(const glm::ivec2& coords) {
+    auto index = slot_index(coords);
+    return index < 0 ? nullptr : &slots_[index].value;
+  }
+
+  const T* find(const glm::ivec2& coords) const {
+    auto index = slot_index(coords);
+    return index < 0 ? nullptr : &slots_[index].value;
+  }
+
+  // Returns the value for the given chunk, inserting a default-constructed one if necessary.
+  T& operator[](const glm::ivec2& coords) {
+    auto index = slot_index(coords);
+    if (index >= 0) {
+      return slots_[index].value;
+    }
+    grow(coords);
+    if (free_slots_.empty()) {
+      index = static_cast<std::int32_t>(slots_.size());
+      slots_.emplace_back();
+    } else {
+      index = free_slots_.back();
+      free_slots_.pop_back();
+    }
+    auto& slot = slots_[index];
+    slot.coords = coords;
+    slot.occupied = true;
+    grid_[grid_index(coords)] = index;
+    ++size_;
+    return slot.value;
+  }
+
+  // Removes the value for the given chunk, releasing its storage. Returns false if there was none.
+  bool erase(const glm::ivec2& coords) {
+    auto index = slot_index(coords);
+    if (index < 0) {
+      return false;
+    }
+    auto& slot = slots_[index];
+    slot.occupied = false;
+    slot.value = T{};
+    grid_[grid_index(coords)] = -1;
+    free_slots_.push_back(index);
+    --size_;
+    // Checking is linear in the number of slots, so only do it every so often.
+    if (++erased_ >= kShrinkCheckErases && erased_ >= size_) {
+      erased_ = 0;
+      shrink();
+    }
+    return true;
+  }
+
+  void clear() {
+    slots_.clear();
+    free_slots_.clear();
+    grid_.clear();
+    grid_min_ = {};
+    grid_size_ = {};
+    size_ = 0;
+    erased_ = 0;
+  }
+
+private:
+  static const std::size_t kShrinkCheckErases = 64;
+
+  std::size_t grid_index(const glm::ivec2& coords) const {
+    auto v = coords - grid_min_;
+    return static_cast<std::size_t>(v.y * grid_size_.x + v.x);
+  }
+
+  // Make sure the grid covers the given chunk. The grid at least doubles in each direction it has
+  // to grow, so streaming in a world edge-first costs amortized constant time per chunk.
+  void grow(const glm::ivec2& coords) {
+    auto grid_max = grid_min_ + grid_size_;
+    if (!grid_.empty() && coords.x >= grid_min_.x && coords.y >= grid_min_.y &&
+        coords.x < grid_max.x && coords.y < grid_max.y) {
+      return;
+    }
+
+    glm::ivec2 min = coords;
+    glm::ivec2 max = coords + glm::ivec2{1, 1};
+    if (!grid_.empty()) {
+      min = glm::min(min, grid_min_ - glm::ivec2{coords.x < grid_min_.x ? grid_size_.x : 0,
+                                                 coords.y < grid_min_.y ? grid_size_.y : 0});
+      max = glm::max(max, grid_max + glm::ivec2{coords.x >= grid_max.x ? grid_size_.x : 0,
+                                                coords.y >= grid_max.y ? grid_size_.y : 0});
+    }
+
+    rebuild_grid(min, max);
+  }
+
+  // Fit the grid to the bounding box of the remaining chunks, if that's under a quarter of it.
+  void shrink() {
+    if (!size_) {
+      clear();
+      return;
+    }
+    glm::ivec2 min{std::numeric_limits<std::int32_t>::max()};
+    glm::ivec2 max{std::numeric_limits<std::int32_t>::min()};
+    for (const auto& slot : slots_) {
+      if (slot.occupied) {
+        min = glm::min(min, slot.coords);
+        max = glm::max(max, slot.coords + glm::ivec2{1, 1});
+      }
+    }
+    auto size = max - min;
+    if (4 * static_cast<std::size_t>(size.x * size.y) <= grid_.size()) {
+      rebuild_grid(min, max);
+    }
+  }
+
+  void rebuild_grid(const glm::ivec2& min, const glm::ivec2& max) {
+    grid_min_ = min;
+    grid_size_ = max - min;
+    grid_.assign(static_cast<std::size_t>(grid_size_.x * grid_size_.y), -1);
+    grid_.shrink_to_fit();
+    for (std::size_t i = 0; i < slots_.size(); ++i) {
+      if (slots_[i].occupied) {
+        grid_[grid_index(slots_[i].coords)] = static_cast<std::int32_t>(i);
+      }
+    }
+  }
+
+  std::vector<Slot> slots_;
+  std::vector<std::int32_t> free_slots_;
+  std::vector<std::int32_t> grid_;
+  glm::ivec2 grid_min_;
+  glm::ivec2 grid_size_;
+  std::size_t size_ = 0;
+  // Erases since the grid was last checked for shrinking.
+  std::size_t erased_ = 0;
+};
+
+}  // ::common
+}  // ::gloam
+
+#endif
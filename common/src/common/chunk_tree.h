@@ -0,0 +1,161 @@
+#ifndef GLOAM_COMMON_SRC_COMMON_CHUNK_TREE_H
+#define GLOAM_COMMON_SRC_COMMON_CHUNK_TREE_H
+#include <glm/vec2.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace gloam {
+namespace common {
+
+// Persistent map of values keyed by chunk coordinate. Nodes are never modified once built: a
+// change copies only the nodes on the path down to the chunk and shares the rest, so copying the
+// whole tree is a single reference count, and a copy never sees later changes. Each node splits
+// its area four ways along each axis. Coordinates are zigzag-encoded first, so chunks near the
+// origin stay near the root and the tree only grows as deep as the world is wide.
+template <typename T>
+class ChunkTree {
+public:
+  bool empty() const {
+    return !size_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  const T* find(const glm::ivec2& coords) const {
+    auto x = zigzag(coords.x);
+    auto y = zigzag(coords.y);
+    if (!fits(x, y, depth_)) {
+      return nullptr;
+    }
+    const Node* node = root_.get();
+    for (auto level = depth_; node && level; --level) {
+      node = node->children[child_index(x, y, level)].get();
+    }
+    auto i = child_index(x, y, 0);
+    return node && (node->occupied & (1u << i)) ? &node->values[i] : nullptr;
+  }
+
+  void set(const glm::ivec2& coords, const T& value) {
+    auto x = zigzag(coords.x);
+    auto y = zigzag(coords.y);
+    while (!fits(x, y, depth_)) {
+      if (root_) {
+        auto root = std::make_shared<Node>();
+        root->children[0] = std::move(root_);
+        root_ = std::move(root);
+      }
+      ++depth_;
+    }
+    root_ = update(root_, depth_, x, y, &value);
+  }
+
+  // Returns false if there was no value for the chunk.
+  bool erase(const glm::ivec2& coords) {
+    if (!find(coords)) {
+      return false;
+    }
+    root_ = update(root_, depth_, zigzag(coords.x), zigzag(coords.y), nullptr);
+    return true;
+  }
+
+  void clear() {
+    root_.reset();
+    depth_ = 0;
+    size_ = 0;
+  }
+
+  // Calls f(coords, value) for every value, in no particular order.
+  template <typename F>
+  void for_each(const F& f) const {
+    visit(root_.get(), depth_, 0, 0, f);
+  }
+
+private:
+  // 4x4 children per node.
+  static const std::uint32_t kBits = 2;
+  static const std::uint32_t kChildren = 1 << (2 * kBits);
+
+  struct Node {
+    // Children of inner nodes, or values (with a bit set in occupied for each) of leaves.
+    std::shared_ptr<const Node> children[kChildren];
+    T values[kChildren];
+    std::uint32_t occupied = 0;
+  };
+
+  static std::uint64_t zigzag(std::int32_t value) {
+    return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+  }
+
+  static std::int32_t unzigzag(std::uint64_t value) {
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(value >> 1) ^
+                                     -static_cast<std::uint32_t>(value & 1));
+  }
+
+  static bool fits(std::uint64_t x, std::uint64_t y, std::uint32_t depth) {
+    return !((x | y) >> (kBits * (depth + 1)));
+  }
+
+  static std::uint32_t child_index(std::uint64_t x, std::uint64_t y, std::uint32_t level) {
+    auto mask = (1u << kBits) - 1;
+    return static_cast<std::uint32_t>(x >> (kBits * level) & mask) |
+        static_cast<std::uint32_t>(y >> (kBits * level) & mask) << kBits;
+  }
+
+  // Returns a copy of the node with the value set (or erased, if null), or nullptr if that leaves
+  // it empty.
+  std::shared_ptr<const Node> update(const std::shared_ptr<const Node>& node, std::uint32_t level,
+                                     std::uint64_t x, std::uint64_t y, const T* value) {
+    auto copy = node ? std::make_shared<Node>(*node) : std::make_shared<Node>();
+    auto i = child_index(x, y, level);
+    if (level) {
+      copy->children[i] = update(copy->children[i], level - 1, x, y, value);
+      for (const auto& child : copy->children) {
+        if (child) {
+          return copy;
+        }
+      }
+      return nullptr;
+    }
+    auto bit = 1u << i;
+    if (value) {
+      size_ += !(copy->occupied & bit);
+      copy->values[i] = *value;
+      copy->occupied |= bit;
+    } else {
+      size_ -= !!(copy->occupied & bit);
+      copy->values[i] = T{};
+      copy->occupied &= ~bit;
+    }
+    return copy->occupied ? copy : nullptr;
+  }
+
+  template <typename F>
+  static void visit(const Node* node, std::uint32_t level, std::uint64_t x, std::uint64_t y,
+                    const F& f) {
+    if (!node) {
+      return;
+    }
+    for (std::uint32_t i = 0; i < kChildren; ++i) {
+      auto child_x = x | static_cast<std::uint64_t>(i & ((1u << kBits) - 1)) << (kBits * level);
+      auto child_y = y | static_cast<std::uint64_t>(i >> kBits) << (kBits * level);
+      if (level) {
+        visit(node->children[i].get(), level - 1, child_x, child_y, f);
+      } else if (node->occupied & (1u << i)) {
+        f(glm::ivec2{unzigzag(child_x), unzigzag(child_y)}, node->values[i]);
+      }
+    }
+  }
+
+  std::shared_ptr<const Node> root_;
+  // Levels of inner nodes above the leaves.
+  std::uint32_t depth_ = 0;
+  std::size_t size_ = 0;
+};
+
+}  // ::common
+}  // ::gloam
+
+#endif
@@ -1,5 +1,6 @@
 #ifndef GLOAM_COMMON_SRC_COMMON_CONVERSIONS_H
 #define GLOAM_COMMON_SRC_COMMON_CONVERSIONS_H
+#include "common/src/common/chunk_geometry.h"
 #include "common/src/common/hashes.h"
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
@@ -19,9 +20,7 @@ inline improbable::Coordinates coords(const glm::vec3& coords) {
 }
 
 inline glm::ivec2 tile_coords(const schema::ChunkData& data, std::size_t tile_index) {
-  auto index = static_cast<std::int32_t>(tile_index);
-  auto size = data.chunk_size();
-  return {size * data.chunk_x() + index % size, size * data.chunk_y() + index / size};
+  return tile_coords(data.chunk_size(), {data.chunk_x(), data.chunk_y()}, tile_index);
 }
 
 }  // ::common
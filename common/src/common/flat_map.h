@@ -0,0 +1,282 @@
+#ifndef GLOAM_COMMON_SRC_COMMON_FLAT_MAP_H
+#define GLOAM_COMMON_SRC_COMMON_FLAT_MAP_H
+#include "common/src/common/hashes.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace gloam {
+namespace common {
+
+// Hash map with open addressing and linear probing. Entries live inline in a single power-of-two
+// array, so there is no allocation per entry and lookups touch one or two cache lines. Erasing
+// shifts later entries in the same probe run back, so there are no tombstones.
+//
+// As with std::unordered_map, inserting may invalidate iterators and references; unlike it,
+// erasing may too.
+template <typename K, typename V, typename Hash = mixing_hash<K>, typename Equal = std::equal_to<K>>
+class FlatMap {
+public:
+  using key_type = K;
+  using mapped_type = V;
+  using value_type = std::pair<const K, V>;
+
+  template <typename S, typename M>
+  class basic_iterator {
+  public:
+    basic_iterator(M* map, std::size_t index) : map_{map}, index_{index} {
+      skip();
+    }
+
+    S& operator*() const {
+      return map_->slot(index_);
+    }
+
+    S* operator->() const {
+      return &map_->slot(index_);
+    }
+
+    basic_iterator& operator++() {
+      ++index_;
+      skip();
+      return *this;
+    }
+
+    bool operator==(const basic_iterator& other) const {
+      return index_ == other.index_;
+    }
+
+    bool operator!=(const basic_iterator& other) const {
+      return index_ != other.index_;
+    }
+
+  private:
+    void skip() {
+      while (index_ < map_->occupied_.size() && !map_->occupied_[index_]) {
+        ++index_;
+      }
+    }
+
+    M* map_;
+    std::size_t index_;
+  };
+
+  using iterator = basic_iterator<value_type, FlatMap>;
+  using const_iterator = basic_iterator<const value_type, const FlatMap>;
+
+  FlatMap() = default;
+
+  FlatMap(const FlatMap& other) {
+    reserve(other.size_);
+    for (const auto& pair : other) {
+      emplace(pair.first, pair.second);
+    }
+  }
+
+  FlatMap(FlatMap&& other) {
+    swap(other);
+  }
+
+  FlatMap& operator=(FlatMap other) {
+    swap(other);
+    return *this;
+  }
+
+  ~FlatMap() {
+    destroy();
+  }
+
+  void swap(FlatMap& other) {
+    std::swap(slots_, other.slots_);
+    std::swap(occupied_, other.occupied_);
+    std::swap(size_, other.size_);
+  }
+
+  iterator begin() {
+    return {this, 0};
+  }
+
+  iterator end() {
+    return {this, occupied_.size()};
+  }
+
+  const_iterator begin() const {
+    return {this, 0};
+  }
+
+  const_iterator end() const {
+    return {this, occupied_.size()};
+  }
+
+  bool empty() const {
+    return !size_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  iterator find(const K& key) {
+    return {this, find_index(key)};
+  }
+
+  const_iterator find(const K& key) const {
+    return {this, find_index(key)};
+  }
+
+  std::size_t count(const K& key) const {
+    return find_index(key) == occupied_.size() ? 0 : 1;
+  }
+
+  // Returns the value for the given key, inserting a default-constructed one if necessary.
+  V& operator[](const K& key) {
+    return emplace(key).first->second;
+  }
+
+  // Inserts a value constructed from the given arguments, unless the key is already present.
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(const K& key, Args&&... args) {
+    auto index = find_index(key);
+    if (index != occupied_.size()) {
+      return {{this, index}, false};
+    }
+    if (4 * (size_ + 1) > 3 * occupied_.size()) {
+      rehash(std::max(kMinCapacity, 2 * occupied_.size()));
+    }
+    index = free_index(key);
+    new (&slots_[index]) value_type{std::piecewise_construct, std::forward_as_tuple(key),
+                                    std::forward_as_tuple(std::forward<Args>(args)...)};
+    occupied_[index] = true;
+    ++size_;
+    return {{this, index}, true};
+  }
+
+  // Removes the value for the given key. Returns the number of values removed.
+  std::size_t erase(const K& key) {
+    auto index = find_index(key);
+    if (index == occupied_.size()) {
+      return 0;
+    }
+    slot(index).~value_type();
+    occupied_[index] = false;
+    --size_;
+
+    // Shift back later entries in the run that would no longer be reachable across the gap.
+    auto mask = occupied_.size() - 1;
+    for (auto next = (index + 1) & mask; occupied_[next]; next = (next + 1) & mask) {
+      auto home = ideal_index(slot(next).first);
+      bool reachable =
+          index <= next ? home > index && home <= next : home > index || home <= next;
+      if (reachable) {
+        continue;
+      }
+      new (&slots_[index]) value_type{std::move(slot(next))};
+      occupied_[index] = true;
+      slot(next).~value_type();
+      occupied_[next] = false;
+      index = next;
+    }
+    return 1;
+  }
+
+  void clear() {
+    for (std::size_t i = 0; i < occupied_.size(); ++i) {
+      if (occupied_[i]) {
+        slot(i).~value_type();
+        occupied_[i] = false;
+      }
+    }
+    size_ = 0;
+  }
+
+  // Make room for the given number of entries without rehashing.
+  void reserve(std::size_t count) {
+    auto capacity = kMinCapacity;
+    while (4 * count > 3 * capacity) {
+      capacity *= 2;
+    }
+    if (capacity > occupied_.size()) {
+      rehash(capacity);
+    }
+  }
+
+private:
+  static const std::size_t kMinCapacity = 16;
+  using Storage = typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type;
+
+  value_type& slot(std::size_t index) {
+    return *reinterpret_cast<value_type*>(&slots_[index]);
+  }
+
+  const value_type& slot(std::size_t index) const {
+    return *reinterpret_cast<const value_type*>(&slots_[index]);
+  }
+
+  std::size_t ideal_index(const K& key) const {
+    return Hash{}(key) & (occupied_.size() - 1);
+  }
+
+  // Index of the entry with the given key, or the capacity if there is none.
+  std::size_t find_index(const K& key) const {
+    if (!size_) {
+      return occupied_.size();
+    }
+    auto mask = occupied_.size() - 1;
+    for (auto index = ideal_index(key); occupied_[index]; index = (index + 1) & mask) {
+      if (Equal{}(slot(index).first, key)) {
+        return index;
+      }
+    }
+    return occupied_.size();
+  }
+
+  // First empty slot in the probe run for the given key.
+  std::size_t free_index(const K& key) const {
+    auto mask = occupied_.size() - 1;
+    auto index = ideal_index(key);
+    while (occupied_[index]) {
+      index = (index + 1) & mask;
+    }
+    return index;
+  }
+
+  void rehash(std::size_t capacity) {
+    std::unique_ptr<Storage[]> slots{new Storage[capacity]};
+    std::vector<std::uint8_t> occupied(capacity, 0);
+    std::swap(slots, slots_);
+    std::swap(occupied, occupied_);
+    for (std::size_t i = 0; i < occupied.size(); ++i) {
+      if (occupied[i]) {
+        auto& old = *reinterpret_cast<value_type*>(&slots[i]);
+        auto index = free_index(old.first);
+        new (&slots_[index]) value_type{std::move(old)};
+        occupied_[index] = true;
+        old.~value_type();
+      }
+    }
+  }
+
+  void destroy() {
+    clear();
+    slots_.reset();
+    occupied_.clear();
+  }
+
+  std::unique_ptr<Storage[]> slots_;
+  std::vector<std::uint8_t> occupied_;
+  std::size_t size_ = 0;
+};
+
+template <typename K, typename V, typename Hash, typename Equal>
+const std::size_t FlatMap<K, V, Hash, Equal>::kMinCapacity;
+
+}  // ::common
+}  // ::gloam
+
+#endif
@@ -2,6 +2,8 @@
 #define GLOAM_COMMON_SRC_COMMON_HASHES_H
 #include <glm/vec2.hpp>
 #include <improbable/standard_library.h>
+#include <cstdint>
+#include <functional>
 
 namespace gloam {
 namespace common {
@@ -19,6 +21,36 @@ struct identity_hash {
   }
 };
 
+// Final mixing step of splitmix64: every input bit affects every output bit, so the low bits can be
+// used directly as a table index.
+inline std::uint64_t mix_bits(std::uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+// Hash for open-addressed tables. std::hash is the identity for integers on common standard
+// libraries, which clusters badly for entity IDs and grid coordinates.
+template <typename T>
+struct mixing_hash {
+  std::size_t operator()(const T& t) const {
+    return static_cast<std::size_t>(mix_bits(std::hash<T>{}(t)));
+  }
+};
+
+// Packs both components of an integer vector into one word before mixing.
+template <typename T, glm::precision P>
+struct mixing_hash<glm::tvec2<T, P>> {
+  std::size_t operator()(const glm::tvec2<T, P>& v) const {
+    auto x = static_cast<std::uint64_t>(static_cast<std::uint32_t>(v.x));
+    auto y = static_cast<std::uint64_t>(static_cast<std::uint32_t>(v.y));
+    return static_cast<std::size_t>(mix_bits(x | y << 32));
+  }
+};
+
 }  // ::common
 }  // ::gloam
 
@@ -0,0 +1,89 @@
+#ifndef GLOAM_COMMON_SRC_COMMON_MPSC_QUEUE_H
+#define GLOAM_COMMON_SRC_COMMON_MPSC_QUEUE_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace gloam {
+namespace common {
+
+// Bounded lock-free queue for any number of producer threads and exactly one consumer thread.
+// Each slot in the power-of-two ring carries a sequence number saying whether it's ready to be
+// written or read, so producers only contend on claiming the tail (Vyukov's bounded queue).
+template <typename T>
+class MpscQueue {
+public:
+  explicit MpscQueue(std::size_t capacity) {
+    size_ = 1;
+    while (size_ < capacity) {
+      size_ *= 2;
+    }
+    slots_.reset(new Slot[size_]);
+    for (std::size_t i = 0; i < size_; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  std::size_t capacity() const {
+    return size_;
+  }
+
+  // Any thread. Leaves the value alone and returns false if the queue is full.
+  bool try_push(T&& value) {
+    auto tail = tail_.value.load(std::memory_order_relaxed);
+    while (true) {
+      auto& slot = slots_[tail & (size_ - 1)];
+      auto sequence = slot.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(tail);
+      if (diff < 0) {
+        return false;
+      }
+      if (diff > 0) {
+        tail = tail_.value.load(std::memory_order_relaxed);
+      } else if (tail_.value.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+        slot.value = std::move(value);
+        slot.sequence.store(tail + 1, std::memory_order_release);
+        return true;
+      }
+    }
+  }
+
+  // Consumer only. Returns false if the queue is empty, or the next value is still being written.
+  bool try_pop(T& value) {
+    auto head = head_.value.load(std::memory_order_relaxed);
+    auto& slot = slots_[head & (size_ - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+      return false;
+    }
+    value = std::move(slot.value);
+    slot.sequence.store(head + size_, std::memory_order_release);
+    head_.value.store(head + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+private:
+  struct Slot {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  struct Counter {
+    std::atomic<std::size_t> value{0};
+    char padding[64 - sizeof(std::atomic<std::size_t>)];
+  };
+
+  std::size_t size_;
+  std::unique_ptr<Slot[]> slots_;
+  Counter head_;
+  Counter tail_;
+};
+
+}  // ::common
+}  // ::gloam
+
+#endif
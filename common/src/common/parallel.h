@@ -0,0 +1,18 @@
+#ifndef GLOAM_COMMON_SRC_COMMON_PARALLEL_H
+#define GLOAM_COMMON_SRC_COMMON_PARALLEL_H
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+
+namespace gloam {
+namespace common {
+
+// Number of threads worth running CPU-bound work on.
+inline std::size_t hardware_threads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+}  // ::common
+}  // ::gloam
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef GLOAM_COMMON_SRC_COMMON_SPSC_QUEUE_H
+#define GLOAM_COMMON_SRC_COMMON_SPSC_QUEUE_H
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace gloam {
+namespace common {
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread. Values live in
+// a power-of-two ring of default-constructed slots; the head and tail counters sit on separate
+// cache lines so the two threads don't contend on them.
+template <typename T>
+class SpscQueue {
+public:
+  explicit SpscQueue(std::size_t capacity) {
+    std::size_t size = 1;
+    while (size < capacity) {
+      size *= 2;
+    }
+    slots_.resize(size);
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  std::size_t capacity() const {
+    return slots_.size();
+  }
+
+  // Producer only. Leaves the value alone and returns false if the queue is full.
+  bool try_push(T&& value) {
+    auto tail = tail_.value.load(std::memory_order_relaxed);
+    if (tail - head_.value.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+    slots_[tail & (slots_.size() - 1)] = std::move(value);
+    tail_.value.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Returns false if the queue is empty.
+  bool try_pop(T& value) {
+    auto head = head_.value.load(std::memory_order_relaxed);
+    if (head == tail_.value.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = std::move(slots_[head & (slots_.size() - 1)]);
+    head_.value.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  struct Counter {
+    std::atomic<std::size_t> value{0};
+    char padding[64 - sizeof(std::atomic<std::size_t>)];
+  };
+
+  std::vector<T> slots_;
+  Counter head_;
+  Counter tail_;
+};
+
+}  // ::common
+}  // ::gloam
+
+#endif
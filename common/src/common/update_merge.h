@@ -0,0 +1,98 @@
+#ifndef GLOAM_COMMON_SRC_COMMON_UPDATE_MERGE_H
+#define GLOAM_COMMON_SRC_COMMON_UPDATE_MERGE_H
+#include <improbable/standard_library.h>
+#include <schema/chunk.h>
+#include <schema/common.h>
+#include <schema/master.h>
+#include <schema/player.h>
+
+namespace gloam {
+namespace common {
+
+// Merges a component update into an earlier one for the same entity, so that applying the result
+// has the same effect as applying both in order. Used by managed::UpdateBuffer.
+template <typename T>
+struct UpdateMerge;
+
+template <>
+struct UpdateMerge<improbable::Position> {
+  static void merge(improbable::Position::Update& into, const improbable::Position::Update& from) {
+    if (from.coords()) {
+      into.set_coords(*from.coords());
+    }
+  }
+};
+
+template <>
+struct UpdateMerge<schema::InterpolatedPosition> {
+  static void merge(schema::InterpolatedPosition::Update& into,
+                    const schema::InterpolatedPosition::Update& from) {
+    for (const auto& event : from.position()) {
+      into.add_position(event);
+    }
+  }
+};
+
+template <>
+struct UpdateMerge<schema::PlayerClient> {
+  static void merge(schema::PlayerClient::Update& into, const schema::PlayerClient::Update& from) {
+    for (const auto& event : from.sync_input()) {
+      into.add_sync_input(event);
+    }
+  }
+};
+
+template <>
+struct UpdateMerge<schema::PlayerServer> {
+  static void merge(schema::PlayerServer::Update& into, const schema::PlayerServer::Update& from) {
+    for (const auto& event : from.sync_state()) {
+      into.add_sync_state(event);
+    }
+  }
+};
+
+template <>
+struct UpdateMerge<schema::Master> {
+  static void merge(schema::Master::Update& into, const schema::Master::Update& from) {
+    if (from.world_spawned()) {
+      into.set_world_spawned(*from.world_spawned());
+    }
+    if (from.chunks()) {
+      into.set_chunks(*from.chunks());
+    }
+  }
+};
+
+template <>
+struct UpdateMerge<schema::Chunk> {
+  static void merge(schema::Chunk::Update& into, const schema::Chunk::Update& from) {
+    // Receivers apply patches on top of the tiles in the same update, so new tiles replace any
+    // earlier patches rather than having them applied again.
+    if (from.tiles() || from.packed_tiles()) {
+      into.patch().clear();
+    }
+    if (from.chunk_size()) {
+      into.set_chunk_size(*from.chunk_size());
+    }
+    if (from.chunk_x()) {
+      into.set_chunk_x(*from.chunk_x());
+    }
+    if (from.chunk_y()) {
+      into.set_chunk_y(*from.chunk_y());
+    }
+    if (from.tiles()) {
+      into.set_tiles(*from.tiles());
+    }
+    if (from.packed_tiles()) {
+      into.set_packed_tiles(*from.packed_tiles());
+    }
+    for (const auto& event : from.patch()) {
+      into.add_patch(event);
+    }
+  }
+};
+
+}  // ::common
+}  // ::gloam
+
+#endif
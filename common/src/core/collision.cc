@@ -2,12 +2,19 @@
 #include "common/src/common/math.h"
 #include "common/src/core/geometry.h"
 #include "common/src/core/tile_map.h"
+#include "common/src/managed/task_pool.h"
 #include <glm/common.hpp>
 #include <glm/geometric.hpp>
 #include <improbable/worker.h>
 #include <algorithm>
 #include <cmath>
 #include <limits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GLOAM_COLLISION_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace gloam {
 namespace core {
@@ -15,6 +22,15 @@ namespace {
 const float kMaxStepHeight = 1.f / 4;
 const float kTolerance = 1.f / 256;
 const float kToleranceSq = kTolerance * kTolerance;
+const std::int32_t kNoEdge = std::numeric_limits<std::int32_t>::max();
+const std::int32_t kAllLayers = std::numeric_limits<std::int32_t>::min();
+const std::uint32_t kEdgeIdSlack = 1 << 12;
+// Minimum number of chunks to re-extract before it's worth spreading the work across threads.
+const std::size_t kParallelUpdateChunks = 32;
+// Side length, in tiles, of the regions used to group batched queries.
+const std::int32_t kBatchRegionSize = 8;
+// Distance, in tiles, beyond a query's bounds for which a cache gathers edges.
+const std::int32_t kCacheMargin = 2;
 
 std::int32_t coords(float v) {
   return static_cast<std::int32_t>(glm::floor(v));
@@ -69,6 +85,64 @@ float cross_2d(const glm::vec2& a, const glm::vec2& b) {
   return a.x * b.y - a.y * b.x;
 }
 
+// Side length, in cells, of the given level of a height pyramid over a chunk of the given size.
+std::int32_t pyramid_size(std::int32_t chunk_size, std::uint32_t level) {
+  return ((chunk_size - 1) >> level) + 1;
+}
+
+bool coords_less(const glm::ivec2& a, const glm::ivec2& b) {
+  return a.y < b.y || (a.y == b.y && a.x < b.x);
+}
+
+// Sides of a tile: the neighbour across each side, and the direction to scan along it and its
+// endpoints (relative to the tile origin) such that runs of edges come out in clockwise order.
+struct TileSide {
+  glm::ivec2 to;
+  glm::ivec2 step;
+  glm::ivec2 start;
+  glm::ivec2 end;
+};
+
+const TileSide kTileSides[] = {
+    {{0, -1}, {1, 0}, {0, 0}, {1, 0}},
+    {{0, 1}, {-1, 0}, {1, 1}, {0, 1}},
+    {{1, 0}, {0, 1}, {1, 0}, {1, 1}},
+    {{-1, 0}, {0, -1}, {0, 1}, {0, 0}},
+};
+
+// Lowest height layer at which there is an edge between two adjacent tiles, or kNoEdge.
+std::int32_t edge_layer(const TileMap& tile_map, const glm::ivec2& from, const glm::ivec2& to) {
+  auto from_tile = tile_map.tile(from);
+  if (!from_tile) {
+    return kNoEdge;
+  }
+
+  auto to_tile = tile_map.tile(to);
+  if (!to_tile) {
+    return from_tile->height();
+  }
+
+  auto from_height = from_tile->height();
+  auto to_height = to_tile->height();
+  auto from_dir = common::ramp_direction(from_tile->ramp());
+  auto to_dir = common::ramp_direction(to_tile->ramp());
+
+  if (to_height < from_height) {
+    return kNoEdge;
+  }
+  if (to_height == from_height) {
+    bool to_perp = to_dir != glm::ivec2{} && std::abs((to - from).x) != std::abs(to_dir.x);
+    return from_dir != to - from && (to_dir == from - to || (to_perp && from_dir != to_dir))
+        ? kAllLayers
+        : kNoEdge;
+  }
+  if (to_height == 1 + from_height) {
+    return from_dir != to - from || (to_dir != to - from && to_dir != glm::ivec2{}) ? kAllLayers
+                                                                                  : kNoEdge;
+  }
+  return kAllLayers;
+}
+
 float project(const Edge& edge, const glm::vec2& origin, const glm::vec2& projection) {
   // Given v(t) = position + t * projection and w(u) = edge.a + u * (edge.b - edge.a),
   // finds t and u with v(t) = w(u).
@@ -87,121 +161,501 @@ float project(const Edge& edge, const glm::vec2& origin, const glm::vec2& projec
   return std::max(0.f, std::min(1.f, t));
 }
 
+using Corners = std::array<glm::vec2, kBoxCorners>;
+
+// Earliest collision found by a sweep: time of impact along the projection, the candidate edge
+// that was hit, and which test found it. There are three tests per box corner i: 3 * i sweeps the
+// corner into the edge; 3 * i + 1 and 3 * i + 2 sweep the box edge from corner i into the edge's
+// endpoints a and b respectively.
+struct SweepResult {
+  float t;
+  std::size_t edge;
+  std::size_t test;
+};
+
+// Sweeps a box (given by its corners) along the projection against a single edge, updating result
+// if it hits earlier than anything found so far.
+void sweep_edge(const Edge& edge, std::size_t index, const Corners& corners,
+                const glm::vec2& projection, SweepResult& result) {
+  if (!can_collide(edge, projection)) {
+    return;
+  }
+  auto resolve = [&](float t, std::size_t test) {
+    if (t < result.t) {
+      result = {t, index, test};
+    }
+  };
+  for (std::size_t i = 0; i < kBoxCorners; ++i) {
+    Edge box_edge{corners[i], corners[(1 + i) % kBoxCorners]};
+    resolve(project(edge, corners[i], projection), 3 * i);
+    resolve(project(box_edge, edge.a, -projection), 3 * i + 1);
+    resolve(project(box_edge, edge.b, -projection), 3 * i + 2);
+  }
+}
+
+#ifdef GLOAM_COLLISION_SSE2
+__m128 select(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+__m128i select(__m128 mask, __m128i a, __m128i b) {
+  auto m = _mm_castps_si128(mask);
+  return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+// Four-wide project(): each lane projects from origin o along p onto the edge from a to b. Performs
+// exactly the same floating-point operations as the scalar version.
+__m128 project(__m128 ax, __m128 ay, __m128 bx, __m128 by, __m128 ox, __m128 oy, __m128 px,
+               __m128 py) {
+  auto zero = _mm_setzero_ps();
+  auto one = _mm_set1_ps(1.f);
+  auto ex = _mm_sub_ps(bx, ax);
+  auto ey = _mm_sub_ps(by, ay);
+  auto wx = _mm_sub_ps(ax, ox);
+  auto wy = _mm_sub_ps(ay, oy);
+  auto d = _mm_sub_ps(_mm_mul_ps(ex, py), _mm_mul_ps(ey, px));
+  auto t = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(ex, wy), _mm_mul_ps(ey, wx)), d);
+  auto u = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(px, wy), _mm_mul_ps(py, wx)), d);
+  auto edge_tolerance = _mm_div_ps(_mm_set1_ps(kToleranceSq),
+                                   _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)));
+  auto pp = _mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py));
+
+  auto valid = _mm_cmpneq_ps(d, zero);
+  valid = _mm_and_ps(valid, _mm_cmpnlt_ps(u, edge_tolerance));
+  valid = _mm_and_ps(valid, _mm_cmpngt_ps(u, _mm_sub_ps(one, edge_tolerance)));
+  valid = _mm_and_ps(valid, _mm_cmpnlt_ps(_mm_mul_ps(t, pp), _mm_set1_ps(-kToleranceSq)));
+  return select(valid, _mm_max_ps(_mm_min_ps(t, one), zero), one);
+}
+#endif
+
+// Sweeps a box against every edge in the list, and returns the earliest collision. Ties go to the
+// first edge and test in order, so the vectorized path finds exactly what the scalar one would.
+SweepResult sweep_edges(const EdgeArray& edges, const Corners& corners,
+                        const glm::vec2& projection) {
+  SweepResult result{1.f, 0, 0};
+  std::size_t j = 0;
+
+#ifdef GLOAM_COLLISION_SSE2
+  auto block_end = edges.size() & ~std::size_t{3};
+  if (block_end) {
+    auto zero = _mm_setzero_ps();
+    auto sign = _mm_set1_ps(-0.f);
+    auto px = _mm_set1_ps(projection.x);
+    auto py = _mm_set1_ps(projection.y);
+    auto nx = _mm_set1_ps(-projection.x);
+    auto ny = _mm_set1_ps(-projection.y);
+
+    // Earliest collision in each lane; since each lane sees its edges in order and only takes
+    // strictly earlier times, it keeps the first edge and test that reach its minimum.
+    auto best_t = _mm_set1_ps(1.f);
+    auto best_edge = _mm_setzero_si128();
+    auto best_test = _mm_setzero_si128();
+    for (; j < block_end; j += 4) {
+      auto ax = _mm_loadu_ps(&edges.ax[j]);
+      auto ay = _mm_loadu_ps(&edges.ay[j]);
+      auto bx = _mm_loadu_ps(&edges.bx[j]);
+      auto by = _mm_loadu_ps(&edges.by[j]);
+      auto ex = _mm_sub_ps(bx, ax);
+      auto ey = _mm_sub_ps(by, ay);
+      auto can_collide =
+          _mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(_mm_xor_ps(ey, sign), px), _mm_mul_ps(ex, py)), zero);
+      if (!_mm_movemask_ps(can_collide)) {
+        continue;
+      }
+
+      auto index = _mm_add_epi32(_mm_set1_epi32(static_cast<std::int32_t>(j)),
+                                 _mm_set_epi32(3, 2, 1, 0));
+      auto resolve = [&](__m128 t, std::size_t test) {
+        auto mask = _mm_and_ps(can_collide, _mm_cmplt_ps(t, best_t));
+        best_t = select(mask, t, best_t);
+        best_edge = select(mask, index, best_edge);
+        best_test = select(mask, _mm_set1_epi32(static_cast<std::int32_t>(test)), best_test);
+      };
+      for (std::size_t i = 0; i < kBoxCorners; ++i) {
+        const auto& c = corners[i];
+        const auto& d = corners[(1 + i) % kBoxCorners];
+        auto cx = _mm_set1_ps(c.x);
+        auto cy = _mm_set1_ps(c.y);
+        auto dx = _mm_set1_ps(d.x);
+        auto dy = _mm_set1_ps(d.y);
+        resolve(project(ax, ay, bx, by, cx, cy, px, py), 3 * i);
+        resolve(project(cx, cy, dx, dy, ax, ay, nx, ny), 3 * i + 1);
+        resolve(project(cx, cy, dx, dy, bx, by, nx, ny), 3 * i + 2);
+      }
+    }
+
+    float lane_t[4];
+    std::int32_t lane_edge[4];
+    std::int32_t lane_test[4];
+    _mm_storeu_ps(lane_t, best_t);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_edge), best_edge);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_test), best_test);
+    for (std::size_t lane = 0; lane < 4; ++lane) {
+      auto edge = static_cast<std::size_t>(lane_edge[lane]);
+      if (lane_t[lane] < result.t ||
+          (lane_t[lane] == result.t && result.t < 1.f && edge < result.edge)) {
+        result = {lane_t[lane], edge, static_cast<std::size_t>(lane_test[lane])};
+      }
+    }
+  }
+#endif
+
+  for (; j < edges.size(); ++j) {
+    sweep_edge(edges[j], j, corners, projection, result);
+  }
+  return result;
+}
+
+// Projects a box (given by its corners, relative to xz) along the projection, sliding along any
+// of the given edges it hits, and returns the unimpeded projection.
+glm::vec2 project_edges(const EdgeArray& edges, const Corners& corners, const glm::vec2& xz,
+                        const glm::vec2& projection_xz) {
+  static const std::uint32_t kMaxIterations = 8;
+  float total_remaining = 1.f;
+  std::uint32_t iteration = 0;
+  glm::vec2 result_vector;
+  glm::vec2 current_projection = projection_xz;
+
+  while (true) {
+    auto offset = xz + result_vector;
+    Corners offset_corners;
+    for (std::size_t i = 0; i < kBoxCorners; ++i) {
+      offset_corners[i] = corners[i] + offset;
+    }
+
+    auto sweep = sweep_edges(edges, offset_corners, current_projection);
+    auto collision_point = sweep.t;
+    result_vector += collision_point * current_projection;
+    if ((1.f - collision_point) * glm::dot(current_projection, current_projection) < kToleranceSq) {
+      break;
+    }
+    auto collision_edge = sweep.test % 3
+        ? Edge{offset_corners[sweep.test / 3], offset_corners[(1 + sweep.test / 3) % kBoxCorners]}
+        : edges[sweep.edge];
+    // Project remaining portion of projection onto edge and continue.
+    total_remaining *= (1.f - collision_point);
+    auto remaining = total_remaining * projection_xz;
+    auto edge = glm::normalize(collision_edge.b - collision_edge.a);
+    auto new_projection = glm::dot(edge, remaining) * edge;
+    if (++iteration == kMaxIterations || new_projection == glm::vec2{} ||
+        new_projection == current_projection) {
+      break;
+    }
+    current_projection = new_projection;
+  }
+  return result_vector;
+}
+
+// Whether candidate i is incident to any tile from min to max inclusive.
+bool incident(const CandidateEdges& candidates, std::size_t i, const glm::ivec2& min,
+              const glm::ivec2& max) {
+  auto tile_min = glm::max(candidates.tile_min[i], min);
+  auto tile_max = glm::min(candidates.tile_max[i], max);
+  return tile_min.x <= tile_max.x && tile_min.y <= tile_max.y;
+}
+
+// Picks out the candidates incident to any tile from min to max inclusive. Since candidates are
+// gathered in an order that doesn't depend on the range, this gives exactly the edges (in the same
+// order) as gathering over the smaller range.
+void filter_edges(const CandidateEdges& candidates, const glm::ivec2& min, const glm::ivec2& max,
+                  EdgeArray& edges) {
+  edges.clear();
+  for (std::size_t i = 0; i < candidates.edges.size(); ++i) {
+    if (incident(candidates, i, min, max)) {
+      edges.push_back(candidates.edges[i]);
+    }
+  }
+}
+
+// Tile range which a box at xz could touch while moving along the projection.
+void query_bounds(const Corners& corners, const glm::vec2& xz, const glm::vec2& projection_xz,
+                  glm::ivec2& min, glm::ivec2& max) {
+  min = glm::min(coords_min(corners, xz), coords_min(corners, xz + projection_xz));
+  max = glm::max(coords_max(corners, xz), coords_max(corners, xz + projection_xz));
+}
+
 }  // anonymous
 
-Collision::Collision(const TileMap& tile_map) : tile_map_{tile_map} {}
+Collision::Collision(const TileMap& tile_map, managed::TaskPool* pool)
+: tile_map_{tile_map}, tile_map_consumer_{tile_map.subscribe()}, pool_{pool} {}
+
+Collision::~Collision() {
+  tile_map_.unsubscribe(tile_map_consumer_);
+}
 
 void Collision::update() {
-  if (!tile_map_.has_changed()) {
+  if (!tile_map_.changes(tile_map_consumer_, tile_map_changes_)) {
     return;
   }
-  layers_.clear();
-  glm::ivec3 min;
-  glm::ivec3 max;
 
-  bool first = true;
-  for (const auto& pair : tile_map_.get()) {
-    glm::ivec3 coords = {pair.first.x, pair.first.y, pair.second.height()};
-    if (first) {
-      min = max = coords;
+  std::vector<glm::ivec2> dirty_chunks;
+  if (tile_map_changes_.reset) {
+    chunks_.clear();
+    for (const auto& slot : tile_map_.chunks()) {
+      dirty_chunks.push_back(slot.coords);
     }
-    min = glm::min(min, coords);
-    max = glm::max(max, coords);
-    first = false;
+  } else {
+    // Edges along the border of a chunk depend on the tiles in neighbouring chunks, so those need
+    // re-extracting too.
+    for (const auto& chunk_coords : tile_map_changes_.chunks) {
+      for (std::int32_t y = -1; y <= 1; ++y) {
+        for (std::int32_t x = -1; x <= 1; ++x) {
+          dirty_chunks.push_back(chunk_coords + glm::ivec2{x, y});
+        }
+      }
+    }
+    // A patched tile only affects the chunks its immediate neighbours are in.
+    for (const auto& tile : tile_map_changes_.tiles) {
+      for (std::int32_t y = -1; y <= 1; ++y) {
+        for (std::int32_t x = -1; x <= 1; ++x) {
+          dirty_chunks.push_back(tile_map_.chunk_coords(tile + glm::ivec2{x, y}));
+        }
+      }
+    }
+    std::sort(dirty_chunks.begin(), dirty_chunks.end(), coords_less);
+    dirty_chunks.erase(std::unique(dirty_chunks.begin(), dirty_chunks.end()), dirty_chunks.end());
   }
 
-  auto has_edge = [&](std::int32_t height, const glm::ivec2& from, const glm::ivec2& to) {
-    auto from_it = tile_map_.get().find(from);
-    if (from_it == tile_map_.get().end()) {
-      return false;
+  // Make room for all the chunks first, so that extraction itself doesn't modify the table and
+  // can run in parallel. Edge IDs are then handed out in order, so the result is the same however
+  // the work was split up.
+  for (const auto& chunk_coords : dirty_chunks) {
+    auto tiles = tile_map_.chunk(chunk_coords);
+    if (tiles && !tiles->empty()) {
+      chunks_[chunk_coords];
+    } else {
+      chunks_.erase(chunk_coords);
     }
-
-    auto to_it = tile_map_.get().find(to);
-    if (to_it == tile_map_.get().end()) {
-      return height >= from_it->second.height();
+  }
+  dirty_chunks_.clear();
+  for (const auto& chunk_coords : dirty_chunks) {
+    auto geometry = chunks_.find(chunk_coords);
+    if (geometry) {
+      dirty_chunks_.push_back({chunk_coords, tile_map_.chunk(chunk_coords), geometry});
+    }
+  }
+  auto extract = [&](std::size_t i) {
+    const auto& dirty = dirty_chunks_[i];
+    extract_chunk(dirty.coords, *dirty.tiles, *dirty.geometry);
+  };
+  if (pool_ && dirty_chunks_.size() >= kParallelUpdateChunks) {
+    pool_->parallel_for(dirty_chunks_.size(), extract);
+  } else {
+    for (std::size_t i = 0; i < dirty_chunks_.size(); ++i) {
+      extract(i);
     }
+  }
+  for (const auto& dirty : dirty_chunks_) {
+    dirty.geometry->edge_id_base = edge_id_count_;
+    edge_id_count_ += static_cast<std::uint32_t>(dirty.geometry->edges.size());
+  }
+  ++generation_;
 
-    auto from_height = from_it->second.height();
-    auto to_height = to_it->second.height();
-    auto from_dir = common::ramp_direction(from_it->second.ramp());
-    auto to_dir = common::ramp_direction(to_it->second.ramp());
+  bool first = true;
+  std::size_t edge_count = 0;
+  min_layer_ = max_layer_ = 0;
+  for (const auto& slot : chunks_) {
+    min_layer_ = first ? slot.value.min_height : std::min(min_layer_, slot.value.min_height);
+    max_layer_ = first ? slot.value.max_height : std::max(max_layer_, slot.value.max_height);
+    edge_count += slot.value.edges.size();
+    first = false;
+  }
 
-    if (to_height < from_height) {
-      return false;
+  if (edge_id_count_ > 2 * edge_count + kEdgeIdSlack) {
+    edge_id_count_ = 0;
+    for (auto& slot : chunks_) {
+      slot.value.edge_id_base = edge_id_count_;
+      edge_id_count_ += static_cast<std::uint32_t>(slot.value.edges.size());
     }
-    if (to_height == from_height) {
-      bool to_perp = to_dir != glm::ivec2{} && std::abs((to - from).x) != std::abs(to_dir.x);
-      return from_dir != to - from && (to_dir == from - to || (to_perp && from_dir != to_dir));
+  }
+}
+
+void Collision::extract_chunk(const glm::ivec2& chunk_coords, const TileMap::ChunkTiles& tiles,
+                              ChunkGeometry& chunk) const {
+  // Scratch (tile, edge) pairs used while building tile_offsets and tile_edges.
+  thread_local std::vector<std::pair<std::uint32_t, std::uint32_t>> tile_edge_pairs;
+
+  auto size = tile_map_.chunk_size();
+  auto origin = size * chunk_coords;
+  chunk.edges.clear();
+  chunk.edge_layers.clear();
+  chunk.edge_tile_min.clear();
+  chunk.edge_tile_max.clear();
+  tile_edge_pairs.clear();
+  chunk.height_planes.clear();
+  chunk.min_height = chunk.max_height = tiles.front().height();
+  for (const auto& tile : tiles) {
+    chunk.min_height = std::min(chunk.min_height, tile.height());
+    chunk.max_height = std::max(chunk.max_height, tile.height());
+    // Ramps rise in their direction, starting from the top of the tile for ramps facing towards
+    // the origin.
+    bool raised =
+        tile.ramp() == schema::Tile::Ramp::kLeft || tile.ramp() == schema::Tile::Ramp::kDown;
+    chunk.height_planes.push_back({static_cast<float>(tile.height()) + raised,
+                                   glm::vec2{common::ramp_direction(tile.ramp())}});
+  }
+
+  chunk.height_pyramid.clear();
+  chunk.pyramid_offsets.clear();
+  for (std::int32_t y = 0; y < size; ++y) {
+    for (std::int32_t x = 0; x < size; ++x) {
+      auto index = static_cast<std::size_t>(y * size + x);
+      if (index >= chunk.height_planes.size()) {
+        chunk.height_pyramid.push_back(
+            {std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(), false});
+        continue;
+      }
+      const auto& plane = chunk.height_planes[index];
+      auto low = glm::min(plane.slope, glm::vec2{0.f});
+      auto high = glm::max(plane.slope, glm::vec2{0.f});
+      chunk.height_pyramid.push_back(
+          {plane.height + low.x + low.y, plane.height + high.x + high.y, true});
     }
-    if (to_height == 1 + from_height) {
-      return from_dir != to - from || (to_dir != to - from && to_dir != glm::ivec2{});
+  }
+  chunk.pyramid_offsets.push_back(0);
+  for (std::uint32_t level = 1; pyramid_size(size, level - 1) > 1; ++level) {
+    auto below_offset = chunk.pyramid_offsets.back();
+    auto below_size = pyramid_size(size, level - 1);
+    auto level_size = pyramid_size(size, level);
+    chunk.pyramid_offsets.push_back(static_cast<std::uint32_t>(chunk.height_pyramid.size()));
+    for (std::int32_t y = 0; y < level_size; ++y) {
+      for (std::int32_t x = 0; x < level_size; ++x) {
+        HeightBounds bounds{std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(),
+                            true};
+        for (auto below_y = 2 * y; below_y < std::min(2 * y + 2, below_size); ++below_y) {
+          for (auto below_x = 2 * x; below_x < std::min(2 * x + 2, below_size); ++below_x) {
+            auto cell = chunk.height_pyramid[below_offset + below_y * below_size + below_x];
+            bounds.min = std::min(bounds.min, cell.min);
+            bounds.max = std::max(bounds.max, cell.max);
+            bounds.loaded = bounds.loaded && cell.loaded;
+          }
+        }
+        chunk.height_pyramid.push_back(bounds);
+      }
     }
-    return true;
-  };
-
-  for (auto height = min.z; height < max.z; ++height) {
-    auto& layer = layers_[height];
+  }
 
-    // X-axis-aligned edges.
-    for (auto y = min.y; y <= max.y; ++y) {
-      std::int32_t scan_start = 0;
-      bool scanning = false;
+  // Edge layers along the current scan line, including one tile beyond the chunk at either end.
+  std::vector<std::int32_t> line(static_cast<std::size_t>(size + 2));
+  for (const auto& side : kTileSides) {
+    glm::ivec2 across = {side.step.y ? 1 : 0, side.step.x ? 1 : 0};
+    glm::ivec2 first = origin + glm::ivec2{side.step.x < 0 ? size - 1 : 0,
+                                           side.step.y < 0 ? size - 1 : 0};
+
+    for (std::int32_t i = 0; i < size; ++i) {
+      auto line_start = first + i * across;
+      for (std::int32_t j = 0; j < size + 2; ++j) {
+        auto coords = line_start + (j - 1) * side.step;
+        line[j] = edge_layer(tile_map_, coords, coords + side.to);
+      }
 
-      for (auto x = min.x; x <= 1 + max.x; ++x) {
-        bool edge = x <= max.x && has_edge(height, {x, y}, {x, y - 1});
-        if (edge && !scanning) {
-          scan_start = x;
-        } else if (!edge && scanning) {
-          layer.edges.push_back({{scan_start, y}, {x, y}});
+      std::int32_t run_start = 0;
+      for (std::int32_t j = 1; j <= size; ++j) {
+        if (line[j] == kNoEdge) {
+          continue;
         }
-        scanning = edge;
-        if (scanning) {
-          layer.tile_lookup[{x, y}].push_back(layer.edges.size());
+        if (j == 1 || line[j - 1] != line[j]) {
+          run_start = j;
+        }
+        if (j != size && line[j + 1] == line[j]) {
+          continue;
         }
-      }
 
-      for (auto x = max.x; 1 + x >= min.x; --x) {
-        bool edge = x >= min.x && has_edge(height, {x, y}, {x, y + 1});
-        if (edge && !scanning) {
-          scan_start = x;
-        } else if (!edge && scanning) {
-          layer.edges.push_back({{1 + scan_start, 1 + y}, {1 + x, 1 + y}});
+        // Where a run is cut short by the chunk boundary or a change of layer but the wall carries
+        // on, overlap the neighbouring edge slightly so nothing can slip through the join. Only
+        // overlap neighbours present at every layer this edge is; the neighbour overlaps us
+        // otherwise.
+        glm::vec2 direction = side.step;
+        glm::vec2 a = line_start + (run_start - 1) * side.step + side.start;
+        glm::vec2 b = line_start + (j - 1) * side.step + side.end;
+        if (line[run_start - 1] <= line[j]) {
+          a -= kTolerance * direction;
         }
-        scanning = edge;
-        if (scanning) {
-          layer.tile_lookup[{x, y}].push_back(layer.edges.size());
+        if (line[j + 1] <= line[j]) {
+          b += kTolerance * direction;
         }
+
+        auto index = static_cast<std::uint32_t>(chunk.edges.size());
+        for (auto k = run_start; k <= j; ++k) {
+          auto v = line_start + (k - 1) * side.step - origin;
+          tile_edge_pairs.emplace_back(static_cast<std::uint32_t>(v.y * size + v.x), index);
+        }
+        auto tile_a = line_start + (run_start - 1) * side.step;
+        auto tile_b = line_start + (j - 1) * side.step;
+        chunk.edges.push_back({a, b});
+        chunk.edge_layers.push_back(line[j]);
+        chunk.edge_tile_min.push_back(glm::min(tile_a, tile_b));
+        chunk.edge_tile_max.push_back(glm::max(tile_a, tile_b));
       }
     }
+  }
 
-    // Y-axis-aligned edges.
-    for (auto x = min.x; x <= max.x; ++x) {
-      std::int32_t scan_start = 0;
-      bool scanning = false;
-
-      for (auto y = min.y; y <= 1 + max.y; ++y) {
-        bool edge = y <= max.y && has_edge(height, {x, y}, {x + 1, y});
-        if (edge && !scanning) {
-          scan_start = y;
-        } else if (!edge && scanning) {
-          layer.edges.push_back({{1 + x, scan_start}, {1 + x, y}});
-        }
-        scanning = edge;
-        if (scanning) {
-          layer.tile_lookup[{x, y}].push_back(layer.edges.size());
+  // Counting sort the (tile, edge) pairs into the lookup. Pairs keep their order within each tile,
+  // and each offset ends up pointing one past its tile's range until shifted back along.
+  auto tile_count = static_cast<std::size_t>(size * size);
+  chunk.tile_offsets.assign(tile_count + 1, 0);
+  for (const auto& pair : tile_edge_pairs) {
+    ++chunk.tile_offsets[pair.first + 1];
+  }
+  for (std::size_t i = 1; i <= tile_count; ++i) {
+    chunk.tile_offsets[i] += chunk.tile_offsets[i - 1];
+  }
+  chunk.tile_edges.resize(tile_edge_pairs.size());
+  for (const auto& pair : tile_edge_pairs) {
+    chunk.tile_edges[chunk.tile_offsets[pair.first]++] = pair.second;
+  }
+  for (auto i = tile_count; i > 0; --i) {
+    chunk.tile_offsets[i] = chunk.tile_offsets[i - 1];
+  }
+  chunk.tile_offsets[0] = 0;
+}
+
+void Collision::gather_edges(std::int32_t layer, const glm::ivec2& min, const glm::ivec2& max,
+                             bool tile_ranges, Context& context) const {
+  // Edges span several tiles, so deduplicate them by stamping each edge ID with the query
+  // generation.
+  if (context.stamps.size() < edge_id_count_) {
+    context.stamps.resize(edge_id_count_);
+  }
+  if (!++context.generation) {
+    std::fill(context.stamps.begin(), context.stamps.end(), 0);
+    context.generation = 1;
+  }
+  context.candidates.clear();
+
+  auto size = tile_map_.chunk_size();
+  auto chunk_min = tile_map_.chunk_coords(min);
+  auto chunk_max = tile_map_.chunk_coords(max);
+  for (auto chunk_y = chunk_min.y; chunk_y <= chunk_max.y; ++chunk_y) {
+    for (auto chunk_x = chunk_min.x; chunk_x <= chunk_max.x; ++chunk_x) {
+      auto chunk = chunks_.find({chunk_x, chunk_y});
+      if (!chunk) {
+        continue;
+      }
+      auto origin = size * glm::ivec2{chunk_x, chunk_y};
+      auto local_min = glm::max(min - origin, glm::ivec2{0});
+      auto local_max = glm::min(max - origin, glm::ivec2{size - 1});
+      context.chunk_edges.clear();
+      for (auto y = local_min.y; y <= local_max.y; ++y) {
+        for (auto x = local_min.x; x <= local_max.x; ++x) {
+          auto tile = y * size + x;
+          for (auto i = chunk->tile_offsets[tile]; i < chunk->tile_offsets[tile + 1]; ++i) {
+            auto index = chunk->tile_edges[i];
+            auto& stamp = context.stamps[chunk->edge_id_base + index];
+            if (stamp != context.generation && chunk->edge_layers[index] <= layer) {
+              stamp = context.generation;
+              context.chunk_edges.push_back(index);
+            }
+          }
         }
       }
 
-      for (auto y = max.y; 1 + y >= min.y; --y) {
-        bool edge = y >= min.y && has_edge(height, {x, y}, {x - 1, y});
-        if (edge && !scanning) {
-          scan_start = y;
-        } else if (!edge && scanning) {
-          layer.edges.push_back({{x, 1 + scan_start}, {x, 1 + y}});
-        }
-        scanning = edge;
-        if (scanning) {
-          layer.tile_lookup[{x, y}].push_back(layer.edges.size());
+      std::sort(context.chunk_edges.begin(), context.chunk_edges.end());
+      for (auto index : context.chunk_edges) {
+        context.candidates.edges.push_back(chunk->edges[index]);
+        if (tile_ranges) {
+          context.candidates.tile_min.push_back(chunk->edge_tile_min[index]);
+          context.candidates.tile_max.push_back(chunk->edge_tile_max[index]);
         }
       }
     }
@@ -210,113 +664,337 @@ void Collision::update() {
 
 glm::vec2 Collision::project_xz(const Box& box, const glm::vec3& position,
                                 const glm::vec2& projection_xz) const {
-  static const std::uint32_t kMaxIterations = 8;
+  thread_local Context context;
+  return project_xz(box, position, projection_xz, context);
+}
 
+glm::vec2 Collision::project_xz(const Box& box, const glm::vec3& position,
+                                const glm::vec2& projection_xz, Context& context) const {
   // TODO: probably need some way of jumping up ramps.
-  auto layer_it = layers_.find(coords(position.y + kMaxStepHeight));
-  if (layer_it == layers_.end()) {
+  auto layer = coords(position.y + kMaxStepHeight);
+  if (layer < min_layer_ || layer >= max_layer_) {
     return projection_xz;
   }
-  const auto& layer = layer_it->second;
   auto corners = get_corners(box);
+  auto xz = common::get_xz(position);
+  glm::ivec2 min;
+  glm::ivec2 max;
+  query_bounds(corners, xz, projection_xz, min, max);
+  gather_edges(layer, min, max, /* tile ranges */ false, context);
+  return project_edges(context.candidates.edges, corners, xz, projection_xz);
+}
 
-  // Find bounding box of projection volume.
+glm::vec2 Collision::project_xz(const Box& box, const glm::vec3& position,
+                                const glm::vec2& projection_xz, Cache& cache) const {
+  thread_local Context context;
+  return project_xz(box, position, projection_xz, cache, context);
+}
+
+glm::vec2 Collision::project_xz(const Box& box, const glm::vec3& position,
+                                const glm::vec2& projection_xz, Cache& cache,
+                                Context& context) const {
+  auto layer = coords(position.y + kMaxStepHeight);
+  if (layer < min_layer_ || layer >= max_layer_) {
+    return projection_xz;
+  }
+  auto corners = get_corners(box);
   auto xz = common::get_xz(position);
-  auto min = glm::min(coords_min(corners, xz), coords_min(corners, xz + projection_xz));
-  auto max = glm::max(coords_max(corners, xz), coords_max(corners, xz + projection_xz));
-
-  // Look up all edges we might intersect.
-  std::unordered_set<std::size_t> edges;
-  for (std::int32_t y = min.y; y <= max.y; ++y) {
-    for (std::int32_t x = min.x; x <= max.x; ++x) {
-      auto it = layer.tile_lookup.find({x, y});
-      if (it != layer.tile_lookup.end()) {
-        edges.insert(it->second.begin(), it->second.end());
+  glm::ivec2 min;
+  glm::ivec2 max;
+  query_bounds(corners, xz, projection_xz, min, max);
+  if (!cache_covers(cache, layer, min, max)) {
+    auto cache_min = min - glm::ivec2{kCacheMargin};
+    auto cache_max = max + glm::ivec2{kCacheMargin};
+    gather_edges(layer, cache_min, cache_max, /* tile ranges */ true, context);
+    fill_cache(cache, layer, cache_min, cache_max, context.candidates);
+  }
+  filter_edges(cache.candidates, min, max, cache.query_edges);
+  return project_edges(cache.query_edges, corners, xz, projection_xz);
+}
+
+void Collision::project_xz(std::size_t count, const Box* boxes, const glm::vec3* positions,
+                           const glm::vec2* projections, glm::vec2* results) const {
+  thread_local Context context;
+  project_xz(count, boxes, positions, projections, results, context);
+}
+
+void Collision::project_xz(std::size_t count, const Box* boxes, const glm::vec3* positions,
+                           const glm::vec2* projections, glm::vec2* results, Context& context,
+                           Cache* const* caches) const {
+  context.batch.clear();
+  for (std::size_t i = 0; i < count; ++i) {
+    auto layer = coords(positions[i].y + kMaxStepHeight);
+    if (layer < min_layer_ || layer >= max_layer_) {
+      results[i] = projections[i];
+      continue;
+    }
+    auto corners = get_corners(boxes[i]);
+    auto xz = common::get_xz(positions[i]);
+    Context::BatchQuery query;
+    query_bounds(corners, xz, projections[i], query.min, query.max);
+    query.cache = caches ? caches[i] : nullptr;
+    if (query.cache && cache_covers(*query.cache, layer, query.min, query.max)) {
+      filter_edges(query.cache->candidates, query.min, query.max, query.cache->query_edges);
+      results[i] = project_edges(query.cache->query_edges, corners, xz, projections[i]);
+      continue;
+    }
+    query.layer = layer;
+    query.region = {common::euclidean_div(query.min.x, kBatchRegionSize),
+                    common::euclidean_div(query.min.y, kBatchRegionSize)};
+    query.index = i;
+    context.batch.push_back(query);
+  }
+  std::sort(context.batch.begin(), context.batch.end(),
+            [](const Context::BatchQuery& a, const Context::BatchQuery& b) {
+              return a.layer < b.layer ||
+                  (a.layer == b.layer &&
+                   (coords_less(a.region, b.region) ||
+                    (a.region == b.region && a.index < b.index)));
+            });
+
+  for (auto it = context.batch.begin(); it != context.batch.end();) {
+    auto group_end = it;
+    auto min = it->min;
+    auto max = it->max;
+    bool tile_ranges = false;
+    while (group_end != context.batch.end() && group_end->layer == it->layer &&
+           group_end->region == it->region) {
+      glm::ivec2 margin{group_end->cache ? kCacheMargin : 0};
+      min = glm::min(min, group_end->min - margin);
+      max = glm::max(max, group_end->max + margin);
+      tile_ranges = tile_ranges || group_end != it || group_end->cache;
+      ++group_end;
+    }
+
+    // Gather edges once for the whole group, then pick out each query's own candidates. Since the
+    // gather order doesn't depend on the range, each query sees exactly the edges it would have on
+    // its own, in the same order.
+    gather_edges(it->layer, min, max, tile_ranges, context);
+    for (; it != group_end; ++it) {
+      auto i = it->index;
+      const auto* edges = &context.candidates.edges;
+      if (it->cache) {
+        fill_cache(*it->cache, it->layer, it->min - glm::ivec2{kCacheMargin},
+                   it->max + glm::ivec2{kCacheMargin}, context.candidates);
+        filter_edges(it->cache->candidates, it->min, it->max, it->cache->query_edges);
+        edges = &it->cache->query_edges;
+      } else if (tile_ranges) {
+        filter_edges(context.candidates, it->min, it->max, context.query_edges);
+        edges = &context.query_edges;
       }
+      results[i] = project_edges(*edges, get_corners(boxes[i]), common::get_xz(positions[i]),
+                                 projections[i]);
     }
   }
+}
 
-  // Test projection.
-  float total_remaining = 1.f;
-  std::uint32_t iteration = 0;
-  glm::vec2 result_vector;
-  glm::vec2 current_projection = projection_xz;
+bool Collision::cache_covers(const Cache& cache, std::int32_t layer, const glm::ivec2& min,
+                             const glm::ivec2& max) const {
+  return cache.valid && cache.generation == generation_ && cache.layer == layer &&
+      min.x >= cache.min.x && min.y >= cache.min.y && max.x <= cache.max.x &&
+      max.y <= cache.max.y;
+}
 
-  while (true) {
-    float collision_point = 1.f;
-    Edge collision_edge;
-    auto resolve_projection = [&](const Edge& edge, float t) {
-      if (t < collision_point) {
-        collision_point = t;
-        collision_edge = edge;
-      }
-    };
+void Collision::fill_cache(Cache& cache, std::int32_t layer, const glm::ivec2& min,
+                           const glm::ivec2& max, const CandidateEdges& candidates) const {
+  cache.valid = true;
+  cache.generation = generation_;
+  cache.layer = layer;
+  cache.min = min;
+  cache.max = max;
+  cache.candidates.clear();
+  for (std::size_t i = 0; i < candidates.edges.size(); ++i) {
+    if (incident(candidates, i, min, max)) {
+      cache.candidates.edges.push_back(candidates.edges[i]);
+      cache.candidates.tile_min.push_back(candidates.tile_min[i]);
+      cache.candidates.tile_max.push_back(candidates.tile_max[i]);
+    }
+  }
+}
+
+float Collision::terrain_height(const Box& box, const glm::vec3& position) const {
+  // Flat ground is by far the most common case, and the pyramid answers that without looking at
+  // individual tiles.
+  auto xz = common::get_xz(position);
+  HeightRange range;
+  if (!height_bounds(coords(xz - box.radius), coords(xz + box.radius), range) ||
+      range.min != range.max) {
+    range = height_range(box, position);
+  }
+  // TODO: still needs tweaking to not jump up at edges...
+  if (range.max < position.y + kMaxStepHeight) {
+    return std::max(range.max, position.y);
+  }
+  return std::max(range.min, position.y);
+}
+
+float Collision::terrain_height(const glm::vec3& position) const {
+  auto xz = common::get_xz(position);
+  auto tile = glm::floor(xz);
+  auto plane = height_plane(glm::ivec2{tile});
+  return plane ? plane->height + glm::dot(xz - tile, plane->slope) : position.y;
+}
+
+std::array<float, kBoxCorners> Collision::corner_heights(const Box& box,
+                                                         const glm::vec3& position) const {
+  auto corners = get_corners(box);
+  std::array<float, kBoxCorners> heights;
+#ifdef GLOAM_COLLISION_SSE2
+  // Only the plane lookups are per-corner; the fractional positions and plane evaluation are done
+  // for all four corners together.
+  alignas(16) float x[kBoxCorners];
+  alignas(16) float z[kBoxCorners];
+  alignas(16) float base[kBoxCorners];
+  alignas(16) float slope_x[kBoxCorners];
+  alignas(16) float slope_z[kBoxCorners];
+  for (std::size_t i = 0; i < kBoxCorners; ++i) {
+    x[i] = position.x + corners[i].x;
+    z[i] = position.z + corners[i].y;
+    auto plane = height_plane(coords(glm::vec2{x[i], z[i]}));
+    base[i] = plane ? plane->height : position.y;
+    slope_x[i] = plane ? plane->slope.x : 0.f;
+    slope_z[i] = plane ? plane->slope.y : 0.f;
+  }
+  // v - floor(v), with floor built from truncation corrected downwards for negative values.
+  auto fraction = [](__m128 v) {
+    auto truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    auto floor = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, v), _mm_set1_ps(1.f)));
+    return _mm_sub_ps(v, floor);
+  };
+  auto result = _mm_add_ps(
+      _mm_load_ps(base),
+      _mm_add_ps(_mm_mul_ps(fraction(_mm_load_ps(x)), _mm_load_ps(slope_x)),
+                 _mm_mul_ps(fraction(_mm_load_ps(z)), _mm_load_ps(slope_z))));
+  _mm_storeu_ps(heights.data(), result);
+#else
+  for (std::size_t i = 0; i < kBoxCorners; ++i) {
+    heights[i] = terrain_height(position + common::from_xz(corners[i], 0.f));
+  }
+#endif
+  return heights;
+}
 
-    for (const auto& edge_index : edges) {
-      const auto& edge = layer.edges[edge_index];
-      if (!can_collide(edge, current_projection)) {
+Collision::HeightRange Collision::height_range(const Box& box, const glm::vec3& position) const {
+  auto xz = common::get_xz(position);
+  auto min = coords(xz - box.radius);
+  auto max = coords(xz + box.radius);
+
+  bool first = true;
+  HeightRange range{position.y, position.y};
+  auto include = [&](float low, float high) {
+    range.min = first ? low : std::min(range.min, low);
+    range.max = first ? high : std::max(range.max, high);
+    first = false;
+  };
+  for (auto y = min.y; y <= max.y; ++y) {
+    for (auto x = min.x; x <= max.x; ++x) {
+      // Extent of the box within the tile along each axis. The box is widest along one axis at the
+      // point of the tile nearest its centre on the other.
+      glm::vec2 tile_min = glm::ivec2{x, y};
+      glm::vec2 tile_max = tile_min + 1.f;
+      auto nearest = glm::clamp(xz, tile_min, tile_max);
+      auto reach = box.radius - glm::abs(glm::vec2{nearest.y - xz.y, nearest.x - xz.x});
+      auto low = glm::max(tile_min, xz - reach);
+      auto high = glm::min(tile_max, xz + reach);
+      if (reach.x < 0 || reach.y < 0 || low.x > high.x || low.y > high.y) {
         continue;
       }
-      for (std::size_t i = 0; i < corners.size(); ++i) {
-        auto offset = xz + result_vector;
 
-        Edge box_edge{corners[i] + offset, corners[(1 + i) % corners.size()] + offset};
-        resolve_projection(edge, project(edge, corners[i] + offset, current_projection));
-        resolve_projection(box_edge, project(box_edge, edge.a, -current_projection));
-        resolve_projection(box_edge, project(box_edge, edge.b, -current_projection));
+      auto plane = height_plane({x, y});
+      if (!plane) {
+        include(position.y, position.y);
+        continue;
       }
+      // Ramps only slope along one axis, so the extremes along each axis can be taken separately.
+      auto a = plane->slope * (low - tile_min);
+      auto b = plane->slope * (high - tile_min);
+      auto lowest = glm::min(a, b);
+      auto highest = glm::max(a, b);
+      include(plane->height + lowest.x + lowest.y, plane->height + highest.x + highest.y);
     }
+  }
+  return range;
+}
 
-    result_vector += collision_point * current_projection;
-    if ((1.f - collision_point) * glm::dot(current_projection, current_projection) < kToleranceSq) {
-      break;
-    }
-    // Project remaining portion of projection onto edge and continue.
-    total_remaining *= (1.f - collision_point);
-    auto remaining = total_remaining * projection_xz;
-    auto edge = glm::normalize(collision_edge.b - collision_edge.a);
-    auto new_projection = glm::dot(edge, remaining) * edge;
-    if (++iteration == kMaxIterations || new_projection == glm::vec2{} ||
-        new_projection == current_projection) {
-      break;
+bool Collision::height_bounds(const glm::ivec2& min, const glm::ivec2& max,
+                              HeightRange& range) const {
+  auto size = tile_map_.chunk_size();
+  if (!size) {
+    return false;
+  }
+
+  range = {std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()};
+  auto chunk_min = tile_map_.chunk_coords(min);
+  auto chunk_max = tile_map_.chunk_coords(max);
+  for (auto chunk_y = chunk_min.y; chunk_y <= chunk_max.y; ++chunk_y) {
+    for (auto chunk_x = chunk_min.x; chunk_x <= chunk_max.x; ++chunk_x) {
+      auto chunk = chunks_.find({chunk_x, chunk_y});
+      if (!chunk) {
+        return false;
+      }
+      auto origin = size * glm::ivec2{chunk_x, chunk_y};
+      auto local_min = glm::max(min - origin, glm::ivec2{0});
+      auto local_max = glm::min(max - origin, glm::ivec2{size - 1});
+
+      // Read from the finest level at which the range covers at most 2x2 cells.
+      std::uint32_t level = 0;
+      while ((local_max.x >> level) - (local_min.x >> level) > 1 ||
+             (local_max.y >> level) - (local_min.y >> level) > 1) {
+        ++level;
+      }
+      auto level_size = pyramid_size(size, level);
+      auto offset = chunk->pyramid_offsets[level];
+      for (auto y = local_min.y >> level; y <= local_max.y >> level; ++y) {
+        for (auto x = local_min.x >> level; x <= local_max.x >> level; ++x) {
+          const auto& cell = chunk->height_pyramid[offset + y * level_size + x];
+          if (!cell.loaded) {
+            return false;
+          }
+          range.min = std::min(range.min, cell.min);
+          range.max = std::max(range.max, cell.max);
+        }
+      }
     }
-    current_projection = new_projection;
   }
-  return result_vector;
+  return true;
 }
 
-float Collision::terrain_height(const Box& box, const glm::vec3& position) const {
-  auto corners = get_corners(box);
+bool Collision::above_terrain(const glm::vec3& a, const glm::vec3& b) const {
+  return above_terrain(a, b, 0);
+}
 
-  float min = std::numeric_limits<float>::max();
-  float max = std::numeric_limits<float>::min();
-  // TODO: this really needs to check across the whole box rather than just the corners. Also still
-  // needs tweaking to not jump up at edges...
-  for (std::size_t i = 0; i < corners.size(); ++i) {
-    auto height = terrain_height(position + common::from_xz(corners[i], 0.f));
-    min = std::min(min, height);
-    max = std::max(max, height);
+bool Collision::above_terrain(const glm::vec3& a, const glm::vec3& b, std::uint32_t depth) const {
+  static const std::uint32_t kMaxDepth = 12;
+  auto min = coords(glm::min(common::get_xz(a), common::get_xz(b)));
+  auto max = coords(glm::max(common::get_xz(a), common::get_xz(b)));
+  HeightRange range;
+  if (!height_bounds(min, max, range)) {
+    return false;
+  }
+  if (std::min(a.y, b.y) > range.max) {
+    return true;
   }
-  if (max < position.y + kMaxStepHeight) {
-    return std::max(max, position.y);
+  if (min == max || depth == kMaxDepth) {
+    return false;
   }
-  return std::max(min, position.y);
+  // Split the segment, so that each half can be ruled out against tighter bounds.
+  auto midpoint = (a + b) / 2.f;
+  return above_terrain(a, midpoint, 1 + depth) && above_terrain(midpoint, b, 1 + depth);
 }
 
-float Collision::terrain_height(const glm::vec3& position) const {
-  auto it = tile_map_.get().find(coords(common::get_xz(position)));
-  if (it == tile_map_.get().end()) {
-    return position.y;
-  }
-  float ignored;
-  auto fx = std::modf(position.x, &ignored);
-  auto fz = std::modf(position.z, &ignored);
-  fx = fx < 0 ? 1 + fx : fx;
-  fz = fz < 0 ? 1 + fz : fz;
-  return static_cast<float>(it->second.height()) +
-      (it->second.ramp() == schema::Tile::Ramp::kLeft ||
-       it->second.ramp() == schema::Tile::Ramp::kDown) +
-      glm::dot(glm::vec2{fx, fz}, glm::vec2{common::ramp_direction(it->second.ramp())});
+const Collision::HeightPlane* Collision::height_plane(const glm::ivec2& tile) const {
+  auto size = tile_map_.chunk_size();
+  if (!size) {
+    return nullptr;
+  }
+  auto chunk_coords = tile_map_.chunk_coords(tile);
+  auto chunk = chunks_.find(chunk_coords);
+  if (!chunk) {
+    return nullptr;
+  }
+  auto v = tile - size * chunk_coords;
+  auto index = static_cast<std::size_t>(v.y * size + v.x);
+  return index < chunk->height_planes.size() ? &chunk->height_planes[index] : nullptr;
 }
 
 }  // ::core
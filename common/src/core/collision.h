@@ -1,17 +1,21 @@
 #ifndef GLOAM_COMMON_SRC_CORE_COLLISION_H
 #define GLOAM_COMMON_SRC_CORE_COLLISION_H
-#include "common/src/common/hashes.h"
+#include "common/src/common/chunk_table.h"
 #include "common/src/core/geometry.h"
+#include "common/src/core/tile_map.h"
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <schema/chunk.h>
+#include <array>
 #include <cstdint>
-#include <unordered_map>
 #include <vector>
 
 namespace gloam {
+namespace managed {
+class TaskPool;
+}  // ::managed
+
 namespace core {
-class TileMap;
 
 // 2D edges are in clockwise order (i.e. outward-facing normals on the left).
 struct Edge {
@@ -19,35 +23,233 @@ struct Edge {
   glm::vec2 b;
 };
 
+// List of edges stored as separate arrays of coordinates, so that queries stream through
+// contiguous memory.
+struct EdgeArray {
+  std::size_t size() const {
+    return ax.size();
+  }
+
+  Edge operator[](std::size_t i) const {
+    return {{ax[i], ay[i]}, {bx[i], by[i]}};
+  }
+
+  void push_back(const Edge& edge) {
+    ax.push_back(edge.a.x);
+    ay.push_back(edge.a.y);
+    bx.push_back(edge.b.x);
+    by.push_back(edge.b.y);
+  }
+
+  void clear() {
+    ax.clear();
+    ay.clear();
+    bx.clear();
+    by.clear();
+  }
+
+  std::vector<float> ax;
+  std::vector<float> ay;
+  std::vector<float> bx;
+  std::vector<float> by;
+};
+
+// Candidate edges gathered for a query, along with the range of tiles each is incident to.
+struct CandidateEdges {
+  void clear() {
+    edges.clear();
+    tile_min.clear();
+    tile_max.clear();
+  }
+
+  EdgeArray edges;
+  std::vector<glm::ivec2> tile_min;
+  std::vector<glm::ivec2> tile_max;
+};
+
 class Collision {
 public:
-  Collision(const TileMap& tile_map);
-  // Recalculate terrain geometry from the tile map.
+  // Candidate edges cached between queries for a single moving box. Boxes only move a short way
+  // each tick, so the cache holds the edges for a region somewhat larger than the query needs, and
+  // gathers them again only once the box leaves it, changes layer, or the geometry is updated.
+  // Results are exactly the same as uncached queries.
+  class Cache {
+  private:
+    friend class Collision;
+    bool valid = false;
+    std::uint64_t generation = 0;
+    std::int32_t layer = 0;
+    glm::ivec2 min;
+    glm::ivec2 max;
+    CandidateEdges candidates;
+    EdgeArray query_edges;
+  };
+
+  // Scratch space for collision queries. Once grown to fit, a context lets queries run without any
+  // heap allocation. Contexts must not be shared between threads; queries that aren't given one
+  // use a per-thread default.
+  class Context {
+  private:
+    friend class Collision;
+    struct BatchQuery {
+      std::int32_t layer;
+      glm::ivec2 region;
+      std::size_t index;
+      glm::ivec2 min;
+      glm::ivec2 max;
+      Cache* cache;
+    };
+
+    // Candidate edges gathered for the current query. Tile ranges are only filled in when needed
+    // to pick out the candidates of a smaller query.
+    CandidateEdges candidates;
+    // Candidate edges of one query within a batch.
+    EdgeArray query_edges;
+    // Indexes of the edges gathered from a single chunk, before sorting.
+    std::vector<std::uint32_t> chunk_edges;
+    // Query generation at which each edge (by ID) was last gathered, for deduplication.
+    std::vector<std::uint32_t> stamps;
+    std::uint32_t generation = 0;
+    // Queries in the current batch, sorted by layer and region.
+    std::vector<BatchQuery> batch;
+  };
+
+  // Large updates extract chunks on the given pool, which is owned by the caller and mustn't be
+  // running anything else during update(). Without one, everything runs on the calling thread.
+  Collision(const TileMap& tile_map, managed::TaskPool* pool = nullptr);
+  ~Collision();
+  // Recalculate terrain geometry for any chunks that have changed in the tile map.
   void update();
 
   // Project a collision box at position along the given XZ projection vector, and return the
   // modified, unimpeded projection.
   glm::vec2 project_xz(const Box& box, const glm::vec3& position,
                        const glm::vec2& projection) const;
+  glm::vec2 project_xz(const Box& box, const glm::vec3& position, const glm::vec2& projection,
+                       Context& context) const;
+  glm::vec2 project_xz(const Box& box, const glm::vec3& position, const glm::vec2& projection,
+                       Cache& cache) const;
+  glm::vec2 project_xz(const Box& box, const glm::vec3& position, const glm::vec2& projection,
+                       Cache& cache, Context& context) const;
+  // Batched project_xz: for each i < count, results[i] is the projection of boxes[i] at
+  // positions[i] along projections[i], exactly as if queried separately. Nearby queries in the same
+  // height layer share the work of looking up candidate edges. If caches is given, any non-null
+  // caches[i] is used and updated for query i.
+  void project_xz(std::size_t count, const Box* boxes, const glm::vec3* positions,
+                  const glm::vec2* projections, glm::vec2* results) const;
+  void project_xz(std::size_t count, const Box* boxes, const glm::vec3* positions,
+                  const glm::vec2* projections, glm::vec2* results, Context& context,
+                  Cache* const* caches = nullptr) const;
+
+  struct HeightRange {
+    float min;
+    float max;
+  };
 
   // Get the correct height for a particular collision box.
   float terrain_height(const Box& box, const glm::vec3& position) const;
+  // Terrain height at a single point: one height plane read and a multiply-add. Points off the
+  // loaded map count as being at their own height.
+  float terrain_height(const glm::vec3& position) const;
+  // Terrain heights under the corners of a collision box, in get_corners order, all sampled at once
+  // (with SSE2 where available).
+  std::array<float, kBoxCorners> corner_heights(const Box& box, const glm::vec3& position) const;
+  // Exact range of terrain heights anywhere under a collision box. Parts of the box off the loaded
+  // map count as being at the box's own height.
+  HeightRange height_range(const Box& box, const glm::vec3& position) const;
+  // Conservative range of terrain heights over the tiles from min to max inclusive, read from the
+  // height pyramid in O(log n). Returns false if they can't all be bounded, i.e. some of them (or
+  // of the tiles sharing a pyramid cell with them) aren't loaded.
+  bool height_bounds(const glm::ivec2& min, const glm::ivec2& max, HeightRange& range) const;
+  // Whether the segment from a to b passes entirely above the terrain. Conservative: may return
+  // false for segments that pass close above it without touching.
+  bool above_terrain(const glm::vec3& a, const glm::vec3& b) const;
 
 private:
-  // Get the terrain height at a particular point.
-  float terrain_height(const glm::vec3& position) const;
+  // Height of terrain within a single tile, as a function of position within the tile.
+  struct HeightPlane {
+    float height;
+    glm::vec2 slope;
+  };
+
+  // Bounds on terrain height over some block of tiles; loaded is false if any of them are missing.
+  struct HeightBounds {
+    float min;
+    float max;
+    bool loaded;
+  };
+
+  // Returns the height plane of the given tile, or nullptr if it is not loaded.
+  const HeightPlane* height_plane(const glm::ivec2& tile) const;
+  bool above_terrain(const glm::vec3& a, const glm::vec3& b, std::uint32_t depth) const;
+  // Whether the cache holds all the candidate edges for a query over the given tiles and layer.
+  bool cache_covers(const Cache& cache, std::int32_t layer, const glm::ivec2& min,
+                    const glm::ivec2& max) const;
+  // Fill the cache from candidates gathered over a region including the given one.
+  void fill_cache(Cache& cache, std::int32_t layer, const glm::ivec2& min, const glm::ivec2& max,
+                  const CandidateEdges& candidates) const;
+  struct ChunkGeometry;
+  // Extract the geometry of a single chunk from the tile map. Only reads shared state, so can run
+  // for several chunks at once.
+  void extract_chunk(const glm::ivec2& chunk_coords, const TileMap::ChunkTiles& tiles,
+                     ChunkGeometry& chunk) const;
+  // Gather into the context all edges at or below the given layer incident to tiles from min to
+  // max inclusive, ordered by chunk and then by index within the chunk. This order doesn't depend
+  // on the range, so any query sees its edges in the same order however they were gathered.
+  void gather_edges(std::int32_t layer, const glm::ivec2& min, const glm::ivec2& max,
+                    bool tile_ranges, Context& context) const;
 
-  // Layers of world geometry.
-  struct LayerData {
-    // All the edges in this layer.
-    std::vector<Edge> edges;
-    // Acceleration structure: map from tile coordinate to buckets of indexes into edge map, giving
-    // all edges incident to the tile.
-    std::unordered_map<glm::ivec2, std::vector<std::size_t>> tile_lookup;
+  // World geometry for a single chunk. Runs of edges are split at chunk boundaries, so that a
+  // change to the tile map only requires re-extracting the chunks around it.
+  struct ChunkGeometry {
+    // All the edges incident to tiles in this chunk.
+    EdgeArray edges;
+    // Lowest height layer at which each edge applies. Edges between two loaded tiles apply at
+    // every layer; edges along the boundary of the loaded world apply only at or above the height
+    // of the tile they border.
+    std::vector<std::int32_t> edge_layers;
+    // Range of tiles each edge is incident to (always a single row or column).
+    std::vector<glm::ivec2> edge_tile_min;
+    std::vector<glm::ivec2> edge_tile_max;
+    // Acceleration structure in compressed-sparse-row form: for each tile i in the chunk (by row
+    // and then column), tile_edges[tile_offsets[i]] up to tile_edges[tile_offsets[i + 1]] index
+    // into edges giving all edges incident to the tile.
+    std::vector<std::uint32_t> tile_offsets;
+    std::vector<std::uint32_t> tile_edges;
+    // Height plane of each tile in the chunk, by row and then column.
+    std::vector<HeightPlane> height_planes;
+    // Min/max height pyramid over the chunk. Level 0 has a cell bounding each tile's height plane;
+    // each level above has a cell for every 2x2 cells of the one below (rounding up), until there
+    // is a single cell. Level k is stored by row and then column from pyramid_offsets[k].
+    std::vector<HeightBounds> height_pyramid;
+    std::vector<std::uint32_t> pyramid_offsets;
+    // Range of tile heights in the chunk.
+    std::int32_t min_height = 0;
+    std::int32_t max_height = 0;
+    // ID of the first edge in the chunk; the rest are numbered consecutively from it.
+    std::uint32_t edge_id_base = 0;
   };
 
   const TileMap& tile_map_;
-  std::unordered_map<std::uint32_t, LayerData> layers_;
+  std::size_t tile_map_consumer_;
+  TileMap::Changes tile_map_changes_;
+  common::ChunkTable<ChunkGeometry> chunks_;
+  // Height layers containing world geometry, from min_layer_ up to but not including max_layer_.
+  std::int32_t min_layer_ = 0;
+  std::int32_t max_layer_ = 0;
+  // Number of edge IDs handed out. Re-extracted chunks take fresh IDs, and everything is renumbered
+  // once too many have gone stale.
+  std::uint32_t edge_id_count_ = 0;
+  // Incremented whenever the geometry changes, to invalidate caches.
+  std::uint64_t generation_ = 0;
+  // Chunks being re-extracted by the current update.
+  struct DirtyChunk {
+    glm::ivec2 coords;
+    const TileMap::ChunkTiles* tiles;
+    ChunkGeometry* geometry;
+  };
+  std::vector<DirtyChunk> dirty_chunks_;
+  managed::TaskPool* pool_;
 };
 
 }  // ::core
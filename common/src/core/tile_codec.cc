@@ -0,0 +1,125 @@
+#include "common/src/core/tile_codec.h"
+#include <cstdint>
+#include <limits>
+
+namespace gloam {
+namespace core {
+namespace {
+const std::uint32_t kRampBits = 3;
+const std::uint32_t kTerrainBits = 4;
+const std::uint8_t kRunFlag = 0x80;
+const std::uint32_t kMaxRamp = static_cast<std::uint32_t>(schema::Tile::Ramp::kRight);
+// Terrains the schema defines. Update along with schema/chunk.schema.
+const std::uint32_t kMinTerrain = static_cast<std::uint32_t>(schema::Tile::Terrain::kGrass);
+const std::uint32_t kMaxTerrain = static_cast<std::uint32_t>(schema::Tile::Terrain::kGrass);
+static_assert(kMaxTerrain < (1u << kTerrainBits), "Terrain doesn't fit in its header bits");
+// Largest encoded height delta between two int32 heights.
+const std::uint64_t kMaxDelta = 0x1ffffffffull;
+
+void write_varint(std::uint64_t value, std::string& output) {
+  while (value >= 0x80) {
+    output.push_back(static_cast<char>(0x80 | (value & 0x7f)));
+    value >>= 7;
+  }
+  output.push_back(static_cast<char>(value));
+}
+
+bool read_varint(const std::string& input, std::size_t& position, std::uint64_t& value) {
+  value = 0;
+  for (std::uint32_t shift = 0; shift < 64 && position < input.size(); shift += 7) {
+    auto byte = static_cast<std::uint8_t>(input[position++]);
+    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::uint64_t zigzag(std::int64_t value) {
+  return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t value) {
+  return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+bool valid_tile(std::uint32_t terrain, std::uint32_t ramp) {
+  return terrain >= kMinTerrain && terrain <= kMaxTerrain && ramp <= kMaxRamp;
+}
+
+}  // anonymous
+
+bool can_encode(const schema::Tile& tile) {
+  return valid_tile(static_cast<std::uint32_t>(tile.terrain()),
+                    static_cast<std::uint32_t>(tile.ramp()));
+}
+
+bool encode_tiles(const worker::List<schema::Tile>& tiles, std::string& packed) {
+  std::string output;
+  std::int64_t height = 0;
+  for (std::size_t i = 0; i < tiles.size();) {
+    const auto& tile = tiles[i];
+    if (!can_encode(tile)) {
+      return false;
+    }
+    std::size_t run = 1;
+    while (i + run < tiles.size() && tiles[i + run] == tile) {
+      ++run;
+    }
+
+    auto header = static_cast<std::uint8_t>(
+        static_cast<std::uint32_t>(tile.ramp()) |
+        static_cast<std::uint32_t>(tile.terrain()) << kRampBits | (run > 1 ? kRunFlag : 0));
+    output.push_back(static_cast<char>(header));
+    write_varint(zigzag(tile.height() - height), output);
+    if (run > 1) {
+      write_varint(run - 2, output);
+    }
+    height = tile.height();
+    i += run;
+  }
+  packed.swap(output);
+  return true;
+}
+
+bool decode_tiles(const std::string& packed, std::size_t max_tiles,
+                  std::vector<schema::Tile>& tiles) {
+  auto start = tiles.size();
+  auto fail = [&] {
+    tiles.resize(start);
+    return false;
+  };
+
+  std::int64_t height = 0;
+  std::size_t position = 0;
+  while (position < packed.size()) {
+    auto header = static_cast<std::uint8_t>(packed[position++]);
+    auto ramp = header & ((1u << kRampBits) - 1);
+    auto terrain = (header >> kRampBits) & ((1u << kTerrainBits) - 1);
+    std::uint64_t delta = 0;
+    if (!valid_tile(terrain, ramp) || !read_varint(packed, position, delta) || delta > kMaxDelta) {
+      return fail();
+    }
+    std::uint64_t run = 1;
+    if (header & kRunFlag) {
+      if (!read_varint(packed, position, run) || run > max_tiles) {
+        return fail();
+      }
+      run += 2;
+    }
+    height += unzigzag(delta);
+    if (run > max_tiles - (tiles.size() - start) ||
+        height < std::numeric_limits<std::int32_t>::min() ||
+        height > std::numeric_limits<std::int32_t>::max()) {
+      return fail();
+    }
+    schema::Tile tile{static_cast<schema::Tile::Terrain>(terrain),
+                      static_cast<std::int32_t>(height), static_cast<schema::Tile::Ramp>(ramp)};
+    tiles.insert(tiles.end(), static_cast<std::size_t>(run), tile);
+  }
+  return true;
+}
+
+}  // ::core
+}  // ::gloam
@@ -0,0 +1,35 @@
+#ifndef GLOAM_COMMON_SRC_CORE_TILE_CODEC_H
+#define GLOAM_COMMON_SRC_CORE_TILE_CODEC_H
+#include <improbable/worker.h>
+#include <schema/chunk.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gloam {
+namespace core {
+
+// Packed encoding for the tiles of a chunk, in the same order as the tiles list. Tiles are grouped
+// into runs of identical tiles, and each run is written as:
+//   - a header byte: the ramp in bits 0-2, the terrain in bits 3-6, and bit 7 set if the run is
+//     longer than a single tile;
+//   - the height, as a zigzag varint delta from the height of the previous run;
+//   - the run length minus two as a varint, if bit 7 of the header was set.
+// A chunk of flat grass comes to three bytes.
+//
+// Whether the tile's terrain and ramp are ones the schema defines, and so can be encoded.
+bool can_encode(const schema::Tile& tile);
+
+// Returns false if any tile can't be encoded, in which case packed is left as it was.
+bool encode_tiles(const worker::List<schema::Tile>& tiles, std::string& packed);
+
+// Decodes packed tiles, appending them to the given vector. Returns false if the data is malformed,
+// has a terrain or ramp the schema doesn't define, or would decode to more than max_tiles tiles, in
+// which case the vector is left as it was.
+bool decode_tiles(const std::string& packed, std::size_t max_tiles,
+                  std::vector<schema::Tile>& tiles);
+
+}  // ::core
+}  // ::gloam
+
+#endif
@@ -1,66 +1,513 @@
 #include "common/src/core/tile_map.h"
-#include "common/src/common/conversions.h"
+#include "common/src/common/chunk_geometry.h"
+#include "common/src/core/tile_codec.h"
+#include <glm/common.hpp>
 #include <improbable/worker.h>
+#include <algorithm>
+#include <string>
 
 namespace gloam {
 namespace core {
+namespace {
+const std::size_t kMaxJournalSize = 1 << 16;
+const std::string kResidencyRadiusFlag = "chunk_residency_radius";
+const std::string kResidencyMaxChunksFlag = "chunk_residency_max_chunks";
 
-void TileMap::register_callbacks(worker::Connection& connection, worker::Dispatcher& dispatcher) {
-  dispatcher.OnAddEntity([&](const worker::AddEntityOp& op) {
-    connection.SendComponentInterest(op.EntityId, {{schema::Chunk::ComponentId, {true}}});
-  });
+// Finds a tile with the coordinate math specialized for the chunk size. Works with any table of
+// ChunkRefs with a find() like common::ChunkTable's.
+template <typename Table>
+struct TileLookup {
+  template <typename Geometry>
+  const schema::Tile* operator()(const Geometry& geometry) const {
+    auto chunk = chunk_table.find(geometry.chunk_coords(coords));
+    if (!chunk) {
+      return nullptr;
+    }
+    const auto& tiles = (*chunk)->tiles;
+    auto index = geometry.tile_index(geometry.local_coords(coords));
+    return index < tiles.size() ? &tiles[index] : nullptr;
+  }
+  const Table& chunk_table;
+  const glm::ivec2& coords;
+};
 
-  dispatcher.OnAddComponent<schema::Chunk>([&](const worker::AddComponentOp<schema::Chunk>& op) {
-    chunk_map_.emplace(op.EntityId, op.Data);
-    update_chunk(op.Data);
-  });
+template <typename Table>
+const schema::Tile* find_tile(std::int32_t chunk_size, const Table& chunk_table,
+                              const glm::ivec2& coords) {
+  if (!chunk_size) {
+    return nullptr;
+  }
+  return common::with_chunk_geometry(chunk_size, TileLookup<Table>{chunk_table, coords});
+}
 
-  dispatcher.OnRemoveComponent<schema::Chunk>([&](const worker::RemoveComponentOp& op) {
-    auto it = chunk_map_.find(op.EntityId);
-    if (it != chunk_map_.end()) {
-      clear_chunk(it->second);
-      chunk_map_.erase(op.EntityId);
+// Prefers the packed encoding, falling back to the tiles list if it's missing or malformed.
+void read_tiles(const schema::ChunkData& data, std::size_t max_count,
+                TileMap::ChunkTiles& tiles) {
+  tiles.clear();
+  if (data.packed_tiles().empty() || !decode_tiles(data.packed_tiles(), max_count, tiles)) {
+    auto count = std::min(data.tiles().size(), max_count);
+    tiles.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      tiles.push_back(data.tiles()[i]);
     }
-  });
+  }
+}
+}  // anonymous
+
+std::uint64_t TileMap::Snapshot::generation() const {
+  return generation_;
+}
+
+std::int32_t TileMap::Snapshot::chunk_size() const {
+  return chunk_size_;
+}
+
+const schema::Tile* TileMap::Snapshot::tile(const glm::ivec2& coords) const {
+  return find_tile(chunk_size_, chunk_tree_, coords);
+}
+
+TileMap::ChunkRef TileMap::Snapshot::chunk(const glm::ivec2& chunk_coords) const {
+  auto chunk = chunk_tree_.find(chunk_coords);
+  return chunk ? *chunk : nullptr;
+}
+
+const TileMap::ChunkTree& TileMap::Snapshot::chunks() const {
+  return chunk_tree_;
+}
+
+TileMap::TileIterator::TileIterator(const TileMap& tile_map, ChunkTable::const_iterator it)
+: tile_map_{tile_map}, it_{it} {
+  skip();
+}
+
+TileMap::TileRef TileMap::TileIterator::operator*() const {
+  return {common::tile_coords(tile_map_.chunk_size_, it_->coords, index_),
+          it_->value->tiles[index_]};
+}
+
+TileMap::TileIterator& TileMap::TileIterator::operator++() {
+  ++index_;
+  skip();
+  return *this;
+}
+
+bool TileMap::TileIterator::operator!=(const TileIterator& other) const {
+  return it_ != other.it_ || index_ != other.index_;
+}
+
+void TileMap::TileIterator::skip() {
+  while (it_ != tile_map_.chunk_table_.end() && index_ >= it_->value->tiles.size()) {
+    ++it_;
+    index_ = 0;
+  }
+}
+
+TileMap::TileIterator TileMap::TileView::begin() const {
+  return {tile_map, tile_map.chunk_table_.begin()};
+}
+
+TileMap::TileIterator TileMap::TileView::end() const {
+  return {tile_map, tile_map.chunk_table_.end()};
+}
+
+void TileMap::register_callbacks(const GetFlag& get_flag, const SetInterest& set_interest,
+                                 worker::Dispatcher& dispatcher) {
+  set_interest_ = set_interest;
+  auto radius_flag = get_flag(kResidencyRadiusFlag);
+  if (radius_flag) {
+    residency_.radius = static_cast<std::int32_t>(std::stoi(*radius_flag));
+  }
+  auto max_chunks_flag = get_flag(kResidencyMaxChunksFlag);
+  if (max_chunks_flag) {
+    residency_.max_chunks = static_cast<std::size_t>(std::stoul(*max_chunks_flag));
+  }
+
+  dispatcher.OnAddEntity(
+      [this](const worker::AddEntityOp& op) { set_interest_(op.EntityId, true); });
+
+  dispatcher.OnAddComponent<schema::Chunk>(
+      [&](const worker::AddComponentOp<schema::Chunk>& op) { add_chunk(op.EntityId, op.Data); });
+
+  dispatcher.OnRemoveComponent<schema::Chunk>(
+      [&](const worker::RemoveComponentOp& op) { remove_chunk(op.EntityId); });
 
   dispatcher.OnComponentUpdate<schema::Chunk>(
       [&](const worker::ComponentUpdateOp<schema::Chunk>& op) {
-        auto it = chunk_map_.find(op.EntityId);
-        if (it != chunk_map_.end()) {
-          op.Update.ApplyTo(it->second);
-          update_chunk(it->second);
-        }
+        update_chunk(op.EntityId, op.Update);
       });
 }
 
-bool TileMap::has_changed() const {
-  bool result = tile_map_changed_;
-  tile_map_changed_ = false;
-  return result;
+void TileMap::add_chunk(worker::EntityId entity_id, const schema::ChunkData& data) {
+  auto result = chunk_map_.emplace(entity_id, data);
+  if (result.second) {
+    load_chunk(result.first->second);
+  }
+}
+
+void TileMap::remove_chunk(worker::EntityId entity_id) {
+  auto it = chunk_map_.find(entity_id);
+  if (it != chunk_map_.end()) {
+    last_used_.erase({it->second.chunk_x(), it->second.chunk_y()});
+    clear_chunk(it->second);
+    chunk_map_.erase(entity_id);
+  }
+}
+
+void TileMap::update_chunk(worker::EntityId entity_id, const schema::Chunk::Update& update) {
+  auto it = chunk_map_.find(entity_id);
+  if (it == chunk_map_.end()) {
+    return;
+  }
+  auto reload = update.chunk_size() || update.chunk_x() || update.chunk_y();
+  if (!reload && (update.tiles() || update.packed_tiles())) {
+    // Tiles written back after patches that were already applied leave the chunk as it is, so
+    // there's nothing to reload.
+    const auto& data = it->second;
+    auto current =
+        data.chunk_size() == chunk_size_ ? chunk({data.chunk_x(), data.chunk_y()}) : nullptr;
+    auto updated = data;
+    update.ApplyTo(updated);
+    read_tiles(updated, static_cast<std::size_t>(chunk_size_ * chunk_size_), scratch_tiles_);
+    reload = !current || scratch_tiles_ != *current;
+  }
+  if (reload) {
+    restore_tiles(it->second);
+    clear_chunk(it->second);
+    update.ApplyTo(it->second);
+    load_chunk(it->second);
+  }
+  for (const auto& patches : update.patch()) {
+    patch_chunk(it->second, patches);
+  }
+}
+
+void TileMap::set_residency(const Residency& residency) {
+  residency_ = residency;
+}
+
+void TileMap::update_residency(const std::vector<glm::vec2>& focus) {
+  ++residency_tick_;
+  if (chunk_size_ <= 0) {
+    return;
+  }
+  for (const auto& point : focus) {
+    auto centre = chunk_coords(glm::ivec2{glm::floor(point)});
+    for (auto y = centre.y - residency_.radius; y <= centre.y + residency_.radius; ++y) {
+      for (auto x = centre.x - residency_.radius; x <= centre.x + residency_.radius; ++x) {
+        glm::ivec2 coords{x, y};
+        auto it = last_used_.find(coords);
+        if (it != last_used_.end()) {
+          it->second = residency_tick_;
+          continue;
+        }
+        auto evicted = evicted_.find(coords);
+        if (evicted != evicted_.end()) {
+          // The chunk is reloaded when the component is added back.
+          if (set_interest_) {
+            set_interest_(evicted->second, true);
+          }
+          evicted_.erase(coords);
+        }
+      }
+    }
+  }
+
+  if (chunk_table_.size() <= residency_.max_chunks) {
+    return;
+  }
+  std::vector<std::pair<std::uint64_t, worker::EntityId>> candidates;
+  for (const auto& pair : chunk_map_) {
+    const auto& data = pair.second;
+    auto it = last_used_.find({data.chunk_x(), data.chunk_y()});
+    if (data.chunk_size() == chunk_size_ && it != last_used_.end() &&
+        it->second < residency_tick_) {
+      candidates.emplace_back(it->second, pair.first);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+  for (const auto& candidate : candidates) {
+    if (chunk_table_.size() <= residency_.max_chunks) {
+      break;
+    }
+    evict_chunk(candidate.second);
+  }
+}
+
+TileMap::Stats TileMap::stats() const {
+  Stats stats;
+  stats.resident_chunks = chunk_table_.size();
+  stats.evicted_chunks = evicted_.size();
+  stats.bytes = chunk_table_.bytes();
+  for (const auto& entry : chunk_table_) {
+    stats.bytes += sizeof(ChunkVersion) + entry.value->tiles.capacity() * sizeof(schema::Tile);
+  }
+  for (const auto& pair : chunk_map_) {
+    const auto& data = pair.second;
+    stats.bytes += sizeof(schema::ChunkData) + data.tiles().capacity() * sizeof(schema::Tile) +
+        data.packed_tiles().capacity();
+  }
+  return stats;
 }
 
-const std::unordered_map<glm::ivec2, schema::Tile>& TileMap::get() const {
-  return tile_map_;
+void TileMap::add_metrics(const std::string& prefix, worker::Metrics& metrics) const {
+  auto s = stats();
+  metrics.GaugeMetrics[prefix + "resident_chunks"] = static_cast<double>(s.resident_chunks);
+  metrics.GaugeMetrics[prefix + "evicted_chunks"] = static_cast<double>(s.evicted_chunks);
+  metrics.GaugeMetrics[prefix + "bytes"] = static_cast<double>(s.bytes);
 }
 
-void TileMap::update_chunk(const schema::ChunkData& data) {
-  for (std::size_t i = 0; i < data.tiles().size(); ++i) {
-    auto key = common::tile_coords(data, i);
-    auto it = tile_map_.find(key);
-    if (it == tile_map_.end()) {
-      tile_map_.emplace(key, data.tiles()[i]);
-    } else {
-      tile_map_.emplace_hint(tile_map_.erase(it), key, data.tiles()[i]);
+std::size_t TileMap::subscribe() const {
+  Consumer consumer{generation_, generation_ > 0, true};
+  for (std::size_t i = 0; i < consumers_.size(); ++i) {
+    if (!consumers_[i].active) {
+      consumers_[i] = consumer;
+      return i;
     }
   }
-  tile_map_changed_ = true;
+  consumers_.push_back(consumer);
+  return consumers_.size() - 1;
+}
+
+void TileMap::unsubscribe(std::size_t consumer) const {
+  consumers_[consumer].active = false;
+  while (!consumers_.empty() && !consumers_.back().active) {
+    consumers_.pop_back();
+  }
+}
+
+std::uint64_t TileMap::generation() const {
+  return generation_;
+}
+
+bool TileMap::changes(std::size_t consumer, Changes& changes) const {
+  auto& state = consumers_[consumer];
+  changes.generation = generation_;
+  changes.reset = state.reset;
+  changes.chunks.clear();
+  changes.tiles.clear();
+  if (state.generation == generation_ && !state.reset) {
+    return false;
+  }
+
+  if (!state.reset) {
+    auto it = std::upper_bound(journal_.begin(), journal_.end(), state.generation,
+                               [](std::uint64_t generation, const JournalEntry& entry) {
+                                 return generation < entry.generation;
+                               });
+    for (; it != journal_.end(); ++it) {
+      (it->tile ? changes.tiles : changes.chunks).push_back(it->coords);
+    }
+    auto less = [](const glm::ivec2& a, const glm::ivec2& b) {
+      return a.y < b.y || (a.y == b.y && a.x < b.x);
+    };
+    std::sort(changes.chunks.begin(), changes.chunks.end(), less);
+    changes.chunks.erase(std::unique(changes.chunks.begin(), changes.chunks.end()),
+                         changes.chunks.end());
+    std::sort(changes.tiles.begin(), changes.tiles.end(), less);
+    changes.tiles.erase(std::unique(changes.tiles.begin(), changes.tiles.end()),
+                        changes.tiles.end());
+  }
+  state.generation = generation_;
+  state.reset = false;
+
+  // Drop journal entries every consumer has seen.
+  auto oldest = generation_;
+  for (const auto& c : consumers_) {
+    if (c.active) {
+      oldest = std::min(oldest, c.generation);
+    }
+  }
+  while (!journal_.empty() && journal_.front().generation <= oldest) {
+    journal_.pop_front();
+  }
+  return true;
+}
+
+std::int32_t TileMap::chunk_size() const {
+  return chunk_size_;
+}
+
+glm::ivec2 TileMap::chunk_coords(const glm::ivec2& tile) const {
+  return common::chunk_coords(chunk_size_, tile);
+}
+
+const schema::Tile* TileMap::tile(const glm::ivec2& coords) const {
+  return find_tile(chunk_size_, chunk_table_, coords);
+}
+
+const TileMap::ChunkTiles* TileMap::chunk(const glm::ivec2& chunk_coords) const {
+  auto chunk = chunk_table_.find(chunk_coords);
+  return chunk ? &(*chunk)->tiles : nullptr;
+}
+
+TileMap::TileView TileMap::tiles() const {
+  return {*this};
+}
+
+const TileMap::ChunkTable& TileMap::chunks() const {
+  return chunk_table_;
+}
+
+void TileMap::publish() {
+  if (!publishing_) {
+    // Subscribing now starts with a reset, which publishes everything loaded so far.
+    publish_consumer_ = subscribe();
+    publishing_ = true;
+  }
+  if (!changes(publish_consumer_, publish_changes_)) {
+    return;
+  }
+  if (publish_changes_.reset) {
+    published_.clear();
+    for (const auto& entry : chunk_table_) {
+      published_.set(entry.coords, entry.value);
+    }
+  } else {
+    for (const auto& chunk_coords : publish_changes_.chunks) {
+      publish_chunk(chunk_coords);
+    }
+    for (const auto& tile : publish_changes_.tiles) {
+      publish_chunk(chunk_coords(tile));
+    }
+  }
+  // Copying the tree only copies its root; the snapshot shares every node with published_ until
+  // the next change replaces the path to some chunk.
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->generation_ = publish_changes_.generation;
+  snapshot->chunk_size_ = chunk_size_;
+  snapshot->chunk_tree_ = published_;
+  std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>{std::move(snapshot)});
+}
+
+std::shared_ptr<const TileMap::Snapshot> TileMap::snapshot() const {
+  return std::atomic_load(&snapshot_);
+}
+
+void TileMap::load_chunk(schema::ChunkData& data) {
+  if (data.chunk_size() <= 0) {
+    return;
+  }
+  if (data.chunk_size() != chunk_size_) {
+    // All chunks should have the same size; if it changes anyway, re-key everything we have. This
+    // includes the given chunk, which is always in the chunk map.
+    for (auto& pair : chunk_map_) {
+      restore_tiles(pair.second);
+    }
+    chunk_size_ = data.chunk_size();
+    chunk_table_.clear();
+    last_used_.clear();
+    // Evicted chunks were keyed by the old size. Take them back, to be evicted again as needed.
+    for (const auto& pair : evicted_) {
+      if (set_interest_) {
+        set_interest_(pair.second, true);
+      }
+    }
+    evicted_.clear();
+    for (auto& pair : chunk_map_) {
+      if (pair.second.chunk_size() == chunk_size_) {
+        load_chunk(pair.second);
+      }
+    }
+    mark_reset();
+    return;
+  }
+
+  auto chunk = std::make_shared<ChunkVersion>();
+  read_tiles(data, static_cast<std::size_t>(chunk_size_ * chunk_size_), chunk->tiles);
+  glm::ivec2 chunk_coords{data.chunk_x(), data.chunk_y()};
+  chunk_table_[chunk_coords] = chunk;
+  mark_changed(chunk_coords, false);
+  chunk->version = generation_;
+  last_used_[chunk_coords] = residency_tick_;
+  evicted_.erase(chunk_coords);
+  data.tiles().clear();
+  data.packed_tiles().clear();
+}
+
+void TileMap::restore_tiles(schema::ChunkData& data) const {
+  if (data.chunk_size() != chunk_size_) {
+    return;
+  }
+  auto tiles = chunk({data.chunk_x(), data.chunk_y()});
+  if (tiles) {
+    data.tiles().assign(tiles->begin(), tiles->end());
+    data.packed_tiles().clear();
+  }
 }
 
 void TileMap::clear_chunk(const schema::ChunkData& data) {
-  for (std::size_t i = 0; i < data.tiles().size(); ++i) {
-    tile_map_.erase(common::tile_coords(data, i));
+  if (data.chunk_size() == chunk_size_ && chunk_table_.erase({data.chunk_x(), data.chunk_y()})) {
+    mark_changed({data.chunk_x(), data.chunk_y()}, false);
+  }
+}
+
+void TileMap::evict_chunk(worker::EntityId entity_id) {
+  auto it = chunk_map_.find(entity_id);
+  if (it == chunk_map_.end()) {
+    return;
+  }
+  glm::ivec2 coords{it->second.chunk_x(), it->second.chunk_y()};
+  clear_chunk(it->second);
+  chunk_map_.erase(entity_id);
+  last_used_.erase(coords);
+  evicted_[coords] = entity_id;
+  if (set_interest_) {
+    set_interest_(entity_id, false);
+  }
+}
+
+void TileMap::publish_chunk(const glm::ivec2& chunk_coords) {
+  auto chunk = chunk_table_.find(chunk_coords);
+  if (!chunk) {
+    published_.erase(chunk_coords);
+    return;
+  }
+  auto published = published_.find(chunk_coords);
+  if (!published || *published != *chunk) {
+    published_.set(chunk_coords, *chunk);
+  }
+}
+
+void TileMap::patch_chunk(const schema::ChunkData& data, const schema::TilePatches& patches) {
+  glm::ivec2 chunk_coords{data.chunk_x(), data.chunk_y()};
+  auto current = data.chunk_size() == chunk_size_ ? chunk_table_.find(chunk_coords) : nullptr;
+  if (!current) {
+    return;
+  }
+  // Copy on the first real change; published snapshots may still hold the current version.
+  std::shared_ptr<ChunkVersion> chunk;
+  for (const auto& patch : patches.patches()) {
+    const auto& tiles = chunk ? chunk->tiles : (*current)->tiles;
+    if (patch.index() >= tiles.size() || tiles[patch.index()] == patch.tile()) {
+      continue;
+    }
+    if (!chunk) {
+      chunk = std::make_shared<ChunkVersion>(**current);
+    }
+    chunk->tiles[patch.index()] = patch.tile();
+    mark_changed(common::tile_coords(chunk_size_, chunk_coords, patch.index()), true);
+  }
+  if (chunk) {
+    chunk->version = generation_;
+    *current = chunk;
+  }
+}
+
+void TileMap::mark_changed(const glm::ivec2& coords, bool tile) {
+  journal_.push_back({++generation_, coords, tile});
+  // If some consumer has stopped looking, don't let the journal grow without bound: fall back to
+  // a reset instead.
+  if (journal_.size() > kMaxJournalSize) {
+    mark_reset();
+  }
+}
+
+void TileMap::mark_reset() {
+  ++generation_;
+  journal_.clear();
+  for (auto& consumer : consumers_) {
+    consumer.reset = true;
   }
-  tile_map_changed_ = true;
 }
 
 }  // ::core
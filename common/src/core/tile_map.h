@@ -1,33 +1,232 @@
 #ifndef GLOAM_COMMON_SRC_CORE_TILE_MAP_H
 #define GLOAM_COMMON_SRC_CORE_TILE_MAP_H
-#include "common/src/common/hashes.h"
+#include "common/src/common/chunk_table.h"
+#include "common/src/common/chunk_tree.h"
+#include "common/src/common/flat_map.h"
 #include <glm/vec2.hpp>
+#include <improbable/worker.h>
 #include <schema/chunk.h>
-#include <unordered_map>
-
-namespace worker {
-class Connection;
-class Dispatcher;
-}  // ::worker
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace gloam {
 namespace core {
 
 class TileMap {
 public:
-  // Update the collision map based on callbacks from the dispatcher.
-  void register_callbacks(worker::Connection& connection, worker::Dispatcher& dispatcher);
+  // Tile storage for a single chunk, arranged by row and then column.
+  using ChunkTiles = std::vector<schema::Tile>;
+
+  // Immutable version of a chunk. Changing a chunk creates a new version rather than modifying the
+  // old one, so a reader holding a version never sees it change.
+  struct ChunkVersion {
+    // Generation at which this version was created; increases with each version of a chunk.
+    std::uint64_t version = 0;
+    ChunkTiles tiles;
+  };
+  using ChunkRef = std::shared_ptr<const ChunkVersion>;
+  using ChunkTable = common::ChunkTable<ChunkRef>;
+
+  using ChunkTree = common::ChunkTree<ChunkRef>;
+
+  // Consistent view of every chunk as of some generation. Snapshots are never modified once
+  // published, so they can be read from any thread without locking. Successive snapshots share
+  // everything but the chunks that changed in between.
+  class Snapshot {
+  public:
+    std::uint64_t generation() const;
+    std::int32_t chunk_size() const;
+    const schema::Tile* tile(const glm::ivec2& coords) const;
+    // Returns the given chunk, or nullptr if it was not loaded.
+    ChunkRef chunk(const glm::ivec2& chunk_coords) const;
+    const ChunkTree& chunks() const;
+
+  private:
+    friend class TileMap;
+    std::uint64_t generation_ = 0;
+    std::int32_t chunk_size_ = 0;
+    ChunkTree chunk_tree_;
+  };
+
+  struct TileRef {
+    glm::ivec2 coords;
+    const schema::Tile& tile;
+  };
+
+  // Walks every tile in the map, chunk by chunk in memory order.
+  class TileIterator {
+  public:
+    TileIterator(const TileMap& tile_map, ChunkTable::const_iterator it);
+    TileRef operator*() const;
+    TileIterator& operator++();
+    bool operator!=(const TileIterator& other) const;
+
+  private:
+    void skip();
+
+    const TileMap& tile_map_;
+    ChunkTable::const_iterator it_;
+    std::size_t index_ = 0;
+  };
+
+  struct TileView {
+    TileIterator begin() const;
+    TileIterator end() const;
+    const TileMap& tile_map;
+  };
+
+  // Limits on which chunks stay loaded.
+  struct Residency {
+    // Chunks within this many chunks of a focus point are always kept.
+    std::int32_t radius = 8;
+    // Once more chunks than this are loaded, chunks out of range of every focus point are evicted,
+    // least recently in range first.
+    std::size_t max_chunks = 4096;
+  };
+
+  // Memory accounting.
+  struct Stats {
+    std::size_t resident_chunks = 0;
+    std::size_t evicted_chunks = 0;
+    // Approximate heap memory held for resident chunks.
+    std::size_t bytes = 0;
+  };
 
-  bool has_changed() const;
-  const std::unordered_map<glm::ivec2, schema::Tile>& get() const;
+  // Chunks changed since a consumer last looked.
+  struct Changes {
+    // Generation the consumer is now up-to-date with.
+    std::uint64_t generation = 0;
+    // If set, the consumer missed changes (or has only just subscribed) and should treat every
+    // chunk as changed; the list of chunks is then left empty.
+    bool reset = false;
+    // Deduplicated coordinates of chunks that were added, removed or updated.
+    std::vector<glm::ivec2> chunks;
+    // Deduplicated coordinates of individual tiles changed by patches, outside of the chunks above.
+    std::vector<glm::ivec2> tiles;
+  };
+
+  // Update the collision map based on callbacks from the dispatcher. The connection can be a
+  // worker::Connection or a managed::Connection. The residency limits can be overridden by the
+  // chunk_residency_radius and chunk_residency_max_chunks worker flags.
+  template <typename Connection>
+  void register_callbacks(Connection& connection, worker::Dispatcher& dispatcher) {
+    register_callbacks(
+        [&connection](const std::string& flag_name) {
+          return connection.GetWorkerFlag(flag_name);
+        },
+        [&connection](worker::EntityId entity_id, bool interested) {
+          connection.SendComponentInterest(entity_id,
+                                           {{schema::Chunk::ComponentId, {interested}}});
+        },
+        dispatcher);
+  }
+
+  void set_residency(const Residency& residency);
+  // Set the points (in tile coordinates) to keep chunks loaded around: typically the positions of
+  // authoritative or visible entities. Evicts chunks over the limit, dropping interest in them, and
+  // restores interest in evicted chunks that have come back into range.
+  void update_residency(const std::vector<glm::vec2>& focus);
+  Stats stats() const;
+  // Add the stats as gauge metrics, with names starting with the given prefix.
+  void add_metrics(const std::string& prefix, worker::Metrics& metrics) const;
+
+  // Feed chunk entities in directly, as the dispatcher callbacks do. Lets tools and benchmarks use
+  // a tile map without a connection.
+  void add_chunk(worker::EntityId entity_id, const schema::ChunkData& data);
+  void remove_chunk(worker::EntityId entity_id);
+  // Reloads the chunk if any of its fields changed (tiles the same as the ones already loaded don't
+  // count), then applies any tile patches in place.
+  void update_chunk(worker::EntityId entity_id, const schema::Chunk::Update& update);
+
+  // Register a new consumer of change notifications, returning its ID for use with changes().
+  std::size_t subscribe() const;
+  // Stops tracking changes for a consumer, so the journal no longer waits for it. Its ID may be
+  // handed out again.
+  void unsubscribe(std::size_t consumer) const;
+  // Current generation; incremented every time a chunk is added, removed, updated or patched.
+  std::uint64_t generation() const;
+  // Fills in the chunks that have changed since the given consumer last called this function, and
+  // marks them as seen. Returns false if nothing has changed.
+  bool changes(std::size_t consumer, Changes& changes) const;
+
+  // Side length of each chunk in tiles, or zero if no chunks have been seen yet.
+  std::int32_t chunk_size() const;
+  // Chunk coordinates containing the given tile.
+  glm::ivec2 chunk_coords(const glm::ivec2& tile) const;
+
+  // Returns the tile at the given coordinates, or nullptr if it is not loaded.
+  const schema::Tile* tile(const glm::ivec2& coords) const;
+  // Returns the tiles of the given chunk, or nullptr if it is not loaded.
+  const ChunkTiles* chunk(const glm::ivec2& chunk_coords) const;
+
+  // Range over all loaded tiles.
+  TileView tiles() const;
+  // Range over all loaded chunks (as common::ChunkTable slots).
+  const ChunkTable& chunks() const;
+
+  // Publish the current state of the map as a new snapshot, if it has changed since the last one.
+  // Costs about the number of chunks changed since then, not the size of the map. Only the thread
+  // making changes should call this; once it has, it should keep doing so regularly, since the
+  // change journal is kept for it like any other consumer.
+  void publish();
+  // Returns the most recently published snapshot. Safe to call from any thread.
+  std::shared_ptr<const Snapshot> snapshot() const;
 
 private:
-  void update_chunk(const schema::ChunkData& data);
+  using GetFlag = std::function<worker::Option<std::string>(const std::string&)>;
+  using SetInterest = std::function<void(worker::EntityId, bool)>;
+  void register_callbacks(const GetFlag& get_flag, const SetInterest& set_interest,
+                          worker::Dispatcher& dispatcher);
+
+  void load_chunk(schema::ChunkData& data);
+  void restore_tiles(schema::ChunkData& data) const;
   void clear_chunk(const schema::ChunkData& data);
+  void evict_chunk(worker::EntityId entity_id);
+  void publish_chunk(const glm::ivec2& chunk_coords);
+  void patch_chunk(const schema::ChunkData& data, const schema::TilePatches& patches);
+  void mark_changed(const glm::ivec2& coords, bool tile);
+  void mark_reset();
+
+  // Chunk entity data. Once a chunk is loaded its tiles are dropped from here, and restored from
+  // the chunk table if needed, so that they aren't stored twice.
+  common::FlatMap<worker::EntityId, schema::ChunkData> chunk_map_;
+  std::int32_t chunk_size_ = 0;
+  ChunkTable chunk_table_;
+  ChunkTiles scratch_tiles_;
+  // Only accessed through the std::atomic_* functions for shared_ptr.
+  std::shared_ptr<const Snapshot> snapshot_ = std::make_shared<Snapshot>();
+  // Chunks as of the last snapshot, kept up to date through a change consumer of our own.
+  ChunkTree published_;
+  bool publishing_ = false;
+  std::size_t publish_consumer_ = 0;
+  Changes publish_changes_;
+
+  // Residency state. Chunks are stamped with the residency tick whenever they are in range.
+  SetInterest set_interest_;
+  Residency residency_;
+  std::uint64_t residency_tick_ = 0;
+  common::FlatMap<glm::ivec2, std::uint64_t> last_used_;
+  common::FlatMap<glm::ivec2, worker::EntityId> evicted_;
 
-  std::unordered_map<worker::EntityId, schema::ChunkData> chunk_map_;
-  std::unordered_map<glm::ivec2, schema::Tile> tile_map_;
-  mutable bool tile_map_changed_ = false;
+  // Change journal, shared between consumers and trimmed once every consumer has seen an entry.
+  struct JournalEntry {
+    std::uint64_t generation;
+    // Chunk coordinates, or tile coordinates for a patched tile.
+    glm::ivec2 coords;
+    bool tile;
+  };
+  struct Consumer {
+    std::uint64_t generation;
+    bool reset;
+    bool active;
+  };
+  std::uint64_t generation_ = 0;
+  mutable std::deque<JournalEntry> journal_;
+  mutable std::vector<Consumer> consumers_;
 };
 
 }  // ::core
@@ -0,0 +1,220 @@
+#ifndef GLOAM_COMMON_SRC_MANAGED_CONNECTION_H
+#define GLOAM_COMMON_SRC_MANAGED_CONNECTION_H
+#include "common/src/common/flat_map.h"
+#include <improbable/worker.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gloam {
+namespace managed {
+
+// Thread-safe facade over worker::Connection, which may be used from several threads. Has the same
+// methods as worker::Connection for sending. All sends are queued until flush() is called
+// (typically by a NetworkThread), and go out in the order they were made. The SDK only hands out a
+// request's ID once it's actually sent, so sends of requests return IDs of the connection's own
+// instead. Pass the ID in a response op through request_id() to get back the ID its send returned.
+class Connection {
+public:
+  explicit Connection(worker::Connection& connection) : connection_(connection) {}
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+
+  using Command = std::function<void(worker::Connection&)>;
+
+  // Queues anything else to run against the underlying connection, in order with the other
+  // queued sends.
+  void queue(Command&& command) {
+    std::lock_guard<std::mutex> lock{queue_mutex_};
+    queue_.emplace_back(std::move(command));
+  }
+
+  // Sends everything queued so far.
+  void flush() {
+    std::lock_guard<std::mutex> flush_lock{flush_mutex_};
+    {
+      std::lock_guard<std::mutex> lock{queue_mutex_};
+      sending_.swap(queue_);
+    }
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      for (auto& command : sending_) {
+        command(connection_);
+      }
+    }
+    sending_.clear();
+    expire_request_ids();
+  }
+
+  // Translates the ID in a response op back to the ID that sending the request returned, or to an
+  // ID of 0 if the request wasn't sent through here. IDs are remembered for twice the request's
+  // timeout, after which its response is treated as unknown.
+  template <typename T>
+  worker::RequestId<T> request_id(const worker::RequestId<T>& sent_id) const {
+    worker::RequestId<T> request_id;
+    std::lock_guard<std::mutex> lock{request_ids_mutex_};
+    auto it = request_ids_.find(sent_id.Id);
+    if (it != request_ids_.end()) {
+      request_id.Id = it->second.id;
+    }
+    return request_id;
+  }
+
+  bool IsConnected() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return connection_.IsConnected();
+  }
+
+  // Holds up IsConnected() and GetWorkerFlag() (but not sends, which are queued) while it waits.
+  worker::OpList GetOpList(std::uint32_t timeout_millis) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return connection_.GetOpList(timeout_millis);
+  }
+
+  worker::Option<std::string> GetWorkerFlag(const std::string& flag_name) const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return connection_.GetWorkerFlag(flag_name);
+  }
+
+  void SendLogMessage(worker::LogLevel level, const std::string& logger_name,
+                      const std::string& message) {
+    queue([=](worker::Connection& c) { c.SendLogMessage(level, logger_name, message); });
+  }
+
+  void SendMetrics(worker::Metrics& metrics) {
+    queue([metrics](worker::Connection& c) mutable { c.SendMetrics(metrics); });
+  }
+
+  worker::RequestId<worker::ReserveEntityIdRequest>
+  SendReserveEntityIdRequest(const worker::Option<std::uint32_t>& timeout_millis) {
+    return queue_request<worker::ReserveEntityIdRequest>(
+        timeout_millis,
+        [=](worker::Connection& c) { return c.SendReserveEntityIdRequest(timeout_millis); });
+  }
+
+  worker::RequestId<worker::CreateEntityRequest>
+  SendCreateEntityRequest(const worker::Entity& entity,
+                          const worker::Option<worker::EntityId>& entity_id,
+                          const worker::Option<std::uint32_t>& timeout_millis) {
+    return queue_request<worker::CreateEntityRequest>(timeout_millis, [=](worker::Connection& c) {
+      return c.SendCreateEntityRequest(entity, entity_id, timeout_millis);
+    });
+  }
+
+  worker::RequestId<worker::DeleteEntityRequest>
+  SendDeleteEntityRequest(worker::EntityId entity_id,
+                          const worker::Option<std::uint32_t>& timeout_millis) {
+    return queue_request<worker::DeleteEntityRequest>(timeout_millis, [=](worker::Connection& c) {
+      return c.SendDeleteEntityRequest(entity_id, timeout_millis);
+    });
+  }
+
+  void SendComponentInterest(
+      worker::EntityId entity_id,
+      const worker::Map<worker::ComponentId, worker::InterestOverride>& interest_overrides) {
+    queue([=](worker::Connection& c) { c.SendComponentInterest(entity_id, interest_overrides); });
+  }
+
+  template <typename T>
+  void SendComponentUpdate(worker::EntityId entity_id, const typename T::Update& update) {
+    queue([=](worker::Connection& c) { c.SendComponentUpdate<T>(entity_id, update); });
+  }
+
+  template <typename T>
+  worker::RequestId<worker::OutgoingCommandRequest<T>>
+  SendCommandRequest(worker::EntityId entity_id, const typename T::Request& request,
+                     const worker::Option<std::uint32_t>& timeout_millis) {
+    return queue_request<worker::OutgoingCommandRequest<T>>(timeout_millis,
+                                                            [=](worker::Connection& c) {
+      return c.SendCommandRequest<T>(entity_id, request, timeout_millis);
+    });
+  }
+
+  template <typename T>
+  void SendCommandResponse(worker::RequestId<worker::IncomingCommandRequest<T>> request_id,
+                           const typename T::Response& response) {
+    queue([=](worker::Connection& c) { c.SendCommandResponse<T>(request_id, response); });
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct SentRequest {
+    std::uint32_t id;
+    clock::time_point expiry;
+  };
+
+  // Queues a request, and returns the ID it will be known by. Once sent, the SDK's ID for it maps
+  // back to that one.
+  template <typename R, typename F>
+  worker::RequestId<R> queue_request(const worker::Option<std::uint32_t>& timeout_millis,
+                                     const F& send) {
+    std::uint32_t millis = kDefaultRequestTimeoutMillis;
+    if (timeout_millis) {
+      millis = *timeout_millis;
+    }
+    auto retain = 2 * std::chrono::milliseconds{millis};
+    worker::RequestId<R> request_id;
+    std::lock_guard<std::mutex> lock{queue_mutex_};
+    // 0 means no request.
+    if (!++next_request_id_) {
+      ++next_request_id_;
+    }
+    auto id = request_id.Id = next_request_id_;
+    queue_.emplace_back([this, id, retain, send](worker::Connection& c) {
+      auto sent_id = send(c);
+      std::lock_guard<std::mutex> lock{request_ids_mutex_};
+      request_ids_[sent_id.Id] = {id, clock::now() + retain};
+    });
+    return request_id;
+  }
+
+  // Forgets requests whose responses are overdue. Scans every ID, so only runs once a second.
+  void expire_request_ids() {
+    auto now = clock::now();
+    if (now < next_expiry_) {
+      return;
+    }
+    next_expiry_ = now + std::chrono::seconds{1};
+    expired_.clear();
+    std::lock_guard<std::mutex> lock{request_ids_mutex_};
+    for (const auto& pair : request_ids_) {
+      if (now >= pair.second.expiry) {
+        expired_.push_back(pair.first);
+      }
+    }
+    for (auto id : expired_) {
+      request_ids_.erase(id);
+    }
+  }
+
+  // Used for requests sent without a timeout; no shorter than the SDK's own default.
+  static const std::uint32_t kDefaultRequestTimeoutMillis = 60000;
+
+  worker::Connection& connection_;
+  // Guards connection_.
+  mutable std::mutex mutex_;
+  // Guards sending_, so that batches taken from the queue are sent in order.
+  std::mutex flush_mutex_;
+  std::vector<Command> sending_;
+
+  // Guards queue_ and next_request_id_.
+  std::mutex queue_mutex_;
+  std::vector<Command> queue_;
+  std::uint32_t next_request_id_ = 0;
+
+  // Our ID for each request sent, by the SDK's.
+  mutable std::mutex request_ids_mutex_;
+  common::FlatMap<std::uint32_t, SentRequest> request_ids_;
+  // Only touched by flush(), under flush_mutex_.
+  clock::time_point next_expiry_;
+  std::vector<std::uint32_t> expired_;
+};
+
+}  // ::managed
+}  // ::gloam
+
+#endif
@@ -0,0 +1,83 @@
+#include "common/src/managed/logger.h"
+#include "common/src/managed/connection.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace gloam {
+namespace managed {
+namespace {
+// Messages buffered between flushes before any more are dropped.
+const std::size_t kQueueCapacity = 4096;
+}  // anonymous
+
+AsyncLogger::AsyncLogger(Connection& connection, std::atomic<bool>& connected,
+                         const std::string& logger_name)
+: connection_(connection)
+, connected_(connected)
+, logger_name_{logger_name}
+, queue_{kQueueCapacity} {}
+
+void AsyncLogger::info(const std::string& message) const {
+  push(worker::LogLevel::kInfo, message);
+}
+
+void AsyncLogger::warn(const std::string& message) const {
+  push(worker::LogLevel::kWarn, message);
+}
+
+void AsyncLogger::error(const std::string& message) const {
+  push(worker::LogLevel::kError, message);
+}
+
+void AsyncLogger::fatal(const std::string& message) const {
+  std::cerr << "[fatal] " << message << std::endl;
+  if (!queue_.try_push({worker::LogLevel::kFatal, message})) {
+    // Too important to drop.
+    connection_.SendLogMessage(worker::LogLevel::kFatal, logger_name_, message);
+  }
+  connected_ = false;
+}
+
+void AsyncLogger::flush() {
+  std::shared_ptr<std::vector<Message>> batch{new std::vector<Message>};
+  Message message;
+  while (queue_.try_pop(message)) {
+    batch->emplace_back(std::move(message));
+  }
+  auto dropped = dropped_.load(std::memory_order_relaxed);
+  if (dropped != flushed_dropped_) {
+    batch->push_back({worker::LogLevel::kWarn,
+                      std::to_string(dropped - flushed_dropped_) +
+                          " log messages dropped (too many messages)"});
+    flushed_dropped_ = dropped;
+  }
+  if (batch->empty()) {
+    return;
+  }
+
+  messages_ += batch->size();
+  auto logger_name = logger_name_;
+  connection_.queue([batch, logger_name](worker::Connection& c) {
+    for (const auto& message : *batch) {
+      c.SendLogMessage(message.level, logger_name, message.text);
+    }
+  });
+}
+
+void AsyncLogger::report(worker::Metrics& metrics) {
+  auto dropped = dropped_.load(std::memory_order_relaxed);
+  metrics.GaugeMetrics["managed_log_messages"] = static_cast<double>(messages_);
+  metrics.GaugeMetrics["managed_log_dropped"] = static_cast<double>(dropped - reported_dropped_);
+  messages_ = 0;
+  reported_dropped_ = dropped;
+}
+
+void AsyncLogger::push(worker::LogLevel level, const std::string& message) const {
+  if (!queue_.try_push({level, message})) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+}  // ::managed
+}  // ::gloam
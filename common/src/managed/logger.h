@@ -0,0 +1,61 @@
+#ifndef GLOAM_COMMON_SRC_MANAGED_LOGGER_H
+#define GLOAM_COMMON_SRC_MANAGED_LOGGER_H
+#include "common/src/common/mpsc_queue.h"
+#include "common/src/managed/managed.h"
+#include <improbable/worker.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace gloam {
+namespace managed {
+class Connection;
+
+// ManagedLogger that puts messages on a lock-free queue, so that logging from logic threads never
+// waits on a lock or the network. flush() hands everything queued to the connection in a single
+// batch, which the network thread then sends. Messages that don't fit in the queue are dropped
+// and counted. Fatal messages also go to stderr and mark the worker as disconnected.
+class AsyncLogger : public ManagedLogger {
+public:
+  AsyncLogger(Connection& connection, std::atomic<bool>& connected,
+              const std::string& logger_name);
+
+  void info(const std::string& message) const override;
+  void warn(const std::string& message) const override;
+  void error(const std::string& message) const override;
+  void fatal(const std::string& message) const override;
+  using ManagedLogger::info;
+  using ManagedLogger::warn;
+  using ManagedLogger::error;
+
+  // Queues everything logged so far on the connection, with a warning if anything was dropped.
+  // Call from a single thread only.
+  void flush();
+  // Adds gauges managed_log_messages and managed_log_dropped for messages since the last report.
+  // Same thread as flush() only.
+  void report(worker::Metrics& metrics);
+
+private:
+  struct Message {
+    worker::LogLevel level;
+    std::string text;
+  };
+
+  void push(worker::LogLevel level, const std::string& message) const;
+
+  Connection& connection_;
+  std::atomic<bool>& connected_;
+  std::string logger_name_;
+
+  mutable common::MpscQueue<Message> queue_;
+  mutable std::atomic<std::uint64_t> dropped_{0};
+  // Only touched by flush() and report().
+  std::uint64_t messages_ = 0;
+  std::uint64_t flushed_dropped_ = 0;
+  std::uint64_t reported_dropped_ = 0;
+};
+
+}  // ::managed
+}  // ::gloam
+
+#endif
@@ -1,6 +1,16 @@
 #include "common/src/managed/managed.h"
+#include "common/src/common/parallel.h"
 #include "common/src/common/timing.h"
+#include "common/src/managed/connection.h"
+#include "common/src/managed/logger.h"
+#include "common/src/managed/network.h"
+#include "common/src/managed/profiler.h"
+#include "common/src/managed/scheduler.h"
+#include "common/src/managed/task_pool.h"
+#include "common/src/managed/updates.h"
 #include <improbable/worker.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <sstream>
@@ -9,6 +19,9 @@
 namespace gloam {
 namespace managed {
 namespace {
+const std::string kMaxCatchUpTicksFlag = "managed_max_catch_up_ticks";
+const std::string kMaxTicksPerSyncFlag = "managed_max_ticks_per_sync";
+const std::string kThreadsFlag = "managed_threads";
 
 worker::Connection connect(const worker::ComponentRegistry& registry,
                            const std::string& worker_type, const std::string& worker_id,
@@ -31,37 +44,51 @@ worker::Connection connect(const worker::ComponentRegistry& registry,
   return worker::Connection::ConnectAsync(registry, hostname, port, worker_id, params).Get();
 }
 
-class ManagedLoggerImpl : public ManagedLogger {
-public:
-  ManagedLoggerImpl(worker::Connection& connection, bool& connected, const std::string& logger_name)
-  : connection_{connection}, connected_{connected}, logger_name_{logger_name} {}
-
-  void info(const std::string& message) const override {
-    connection_.SendLogMessage(worker::LogLevel::kInfo, logger_name_, message);
-  }
-
-  void warn(const std::string& message) const override {
-    connection_.SendLogMessage(worker::LogLevel::kWarn, logger_name_, message);
+TickScheduler::Policy scheduler_policy(const worker::Connection& connection) {
+  TickScheduler::Policy policy;
+  auto catch_up_flag = connection.GetWorkerFlag(kMaxCatchUpTicksFlag);
+  if (catch_up_flag) {
+    policy.max_catch_up_ticks = static_cast<std::uint32_t>(std::stoul(*catch_up_flag));
   }
-
-  void error(const std::string& message) const override {
-    connection_.SendLogMessage(worker::LogLevel::kError, logger_name_, message);
+  auto ticks_per_sync_flag = connection.GetWorkerFlag(kMaxTicksPerSyncFlag);
+  if (ticks_per_sync_flag) {
+    policy.max_ticks_per_sync = static_cast<std::uint32_t>(std::stoul(*ticks_per_sync_flag));
   }
+  return policy;
+}
 
-  void fatal(const std::string& message) const override {
-    std::cerr << "[fatal] " << message << std::endl;
-    connection_.SendLogMessage(worker::LogLevel::kFatal, logger_name_, message);
-    connected_ = false;
+bool intersects(const std::vector<const void*>& a, const std::vector<const void*>& b) {
+  for (const auto& p : a) {
+    if (std::find(b.begin(), b.end(), p) != b.end()) {
+      return true;
+    }
   }
+  return false;
+}
 
-private:
-  worker::Connection& connection_;
-  bool& connected_;
-  std::string logger_name_;
-};
+bool conflicts(const Dependencies& a, const Dependencies& b) {
+  return a.exclusive || b.exclusive || intersects(a.writes, b.reads) ||
+      intersects(a.writes, b.writes) || intersects(a.reads, b.writes);
+}
 
 }  // anonymous
 
+bool LogSite::allow(std::uint64_t& suppressed) {
+  auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+  auto start = window_start_.load(std::memory_order_relaxed);
+  if (now - start >= interval_ &&
+      window_start_.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+    count_.store(0, std::memory_order_relaxed);
+  }
+  if (count_.load(std::memory_order_relaxed) >= max_messages_ ||
+      count_.fetch_add(1, std::memory_order_relaxed) >= max_messages_) {
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
 int connect(const worker::ComponentRegistry& registry, const std::string& worker_type,
             const std::vector<WorkerLogic*>& logic, bool enable_protocol_logging, int argc,
             char** argv) {
@@ -76,11 +103,14 @@ int connect(const worker::ComponentRegistry& registry, const std::string& worker
 
   auto connection =
       connect(registry, worker_type, worker_id, hostname, port, enable_protocol_logging);
-  bool connected = true;
+  std::atomic<bool> connected{true};
   worker::Dispatcher dispatcher{registry};
 
-  ManagedLoggerImpl managed_logger{connection, connected, worker_type};
-  ManagedConnection managed_connection{managed_logger, connection, dispatcher};
+  // Once the network thread has started, everything goes through the thread-safe facade.
+  Connection logic_connection{connection};
+  AsyncLogger managed_logger{logic_connection, connected, worker_type};
+  UpdateBuffer updates;
+  ManagedConnection managed_connection{managed_logger, logic_connection, updates, dispatcher};
 
   dispatcher.OnDisconnect([&](const worker::DisconnectOp& op) {
     std::cerr << "[disconnected] " << op.Reason << std::endl;
@@ -101,43 +131,98 @@ int connect(const worker::ComponentRegistry& registry, const std::string& worker
 
   dispatcher.OnMetrics([&](const worker::MetricsOp& op) {
     auto metrics = op.Metrics;
-    connection.SendMetrics(metrics);
+    logic_connection.SendMetrics(metrics);
   });
 
-  std::uint32_t sync = 0;
-  auto next_update = std::chrono::steady_clock::now();
+  // Per-phase timings, reported along with the load.
+  TickProfiler profiler;
+  auto process_phase = profiler.add_phase("managed_process");
+  std::vector<std::size_t> tick_phases;
+  std::vector<std::size_t> sync_phases;
+  for (std::size_t i = 0; i < logic.size(); ++i) {
+    tick_phases.push_back(profiler.add_phase("managed_tick_" + std::to_string(i)));
+    sync_phases.push_back(profiler.add_phase("managed_sync_" + std::to_string(i)));
+  }
+  auto overshoot_phase = profiler.add_phase("managed_sleep_overshoot");
+
+  TickScheduler scheduler{scheduler_policy(connection), std::chrono::steady_clock::now()};
   if (connection.IsConnected()) {
     for (const auto& worker_logic : logic) {
       worker_logic->init(managed_connection);
     }
   }
+
+  // One task per logic, which ticks and then syncs if it's time. Tasks for logic with conflicting
+  // dependencies run in order; the rest can run in parallel.
+  auto threads = common::hardware_threads();
+  auto threads_flag = connection.GetWorkerFlag(kThreadsFlag);
+  if (threads_flag) {
+    threads = static_cast<std::size_t>(std::stoul(*threads_flag));
+  }
+  TaskPool pool{std::min(threads, logic.size())};
+
+  bool sync = false;
+  std::vector<Dependencies> dependencies;
+  for (const auto& worker_logic : logic) {
+    dependencies.push_back(worker_logic->dependencies());
+  }
+  std::vector<TaskPool::Task> tasks;
+  for (std::size_t i = 0; i < logic.size(); ++i) {
+    TaskPool::Task task;
+    task.f = [&, i] {
+      auto tick_point = std::chrono::steady_clock::now();
+      logic[i]->tick();
+      auto sync_point = std::chrono::steady_clock::now();
+      profiler.record(tick_phases[i], sync_point - tick_point);
+      if (sync) {
+        logic[i]->sync();
+        profiler.record(sync_phases[i], std::chrono::steady_clock::now() - sync_point);
+      }
+    };
+    for (std::size_t j = i + 1; j < logic.size(); ++j) {
+      if (conflicts(dependencies[i], dependencies[j])) {
+        task.successors.push_back(j);
+      }
+    }
+    tasks.push_back(task);
+  }
+
+  NetworkThread network{logic_connection};
   while (connected) {
     auto start_point = std::chrono::steady_clock::now();
-    dispatcher.Process(connection.GetOpList(/* millis */ 0));
+    network.process(dispatcher);
     if (!connected) {
       break;
     }
-    for (const auto& worker_logic : logic) {
-      worker_logic->tick();
-      if (!sync) {
-        worker_logic->sync();
-      }
-    }
+    sync = scheduler.sync_due();
+    profiler.record(process_phase, std::chrono::steady_clock::now() - start_point);
+    pool.run(tasks);
+    updates.flush(logic_connection);
+    managed_logger.flush();
 
-    if (!sync) {
+    if (sync) {
       auto update_time = std::chrono::steady_clock::now() - start_point;
       auto load = static_cast<float>(
                       std::chrono::duration_cast<std::chrono::microseconds>(update_time).count()) /
           std::chrono::duration_cast<std::chrono::microseconds>(common::kTickDuration).count();
       worker::Metrics load_report;
       load_report.Load = load;
-      connection.SendMetrics(load_report);
+      profiler.report(load_report);
+      scheduler.report(load_report);
+      network.report(load_report);
+      updates.report(load_report);
+      managed_logger.report(load_report);
+      for (const auto& worker_logic : logic) {
+        worker_logic->report(load_report);
+      }
+      logic_connection.SendMetrics(load_report);
     }
 
-    next_update += common::kTickDuration;
-    std::this_thread::sleep_until(next_update);
-    sync = (1 + sync) % common::kTicksPerSync;
+    scheduler.end_tick(start_point);
+    profiler.record(overshoot_phase, scheduler.wait());
   }
+  // Anything logged on the way out, including fatal errors, is sent as the network thread stops.
+  managed_logger.flush();
   return 1;
 }
 
@@ -1,17 +1,36 @@
 #ifndef GLOAM_COMMON_SRC_MANAGED_MANAGED_H
 #define GLOAM_COMMON_SRC_MANAGED_MANAGED_H
+#include "common/src/managed/connection.h"
+#include "common/src/managed/updates.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <vector>
 
-namespace worker {
-class Connection;
-class Dispatcher;
-class ComponentRegistry;
-}  // ::worker
-
 namespace gloam {
 namespace managed {
 
+// Limits how often a single call site logs: at most max_messages in each interval. Messages over
+// the limit are counted, and the next message let through says how many were suppressed.
+class LogSite {
+public:
+  explicit LogSite(std::uint32_t max_messages = 4,
+                   std::chrono::steady_clock::duration interval = std::chrono::seconds{10})
+  : max_messages_{max_messages}, interval_{interval.count()} {}
+
+  // Returns false if the message should be dropped. Otherwise sets suppressed to the number of
+  // messages dropped since the last one was let through. Any thread.
+  bool allow(std::uint64_t& suppressed);
+
+private:
+  std::uint32_t max_messages_;
+  std::chrono::steady_clock::rep interval_;
+  std::atomic<std::chrono::steady_clock::rep> window_start_{0};
+  std::atomic<std::uint32_t> count_{0};
+  std::atomic<std::uint64_t> suppressed_{0};
+};
+
 class ManagedLogger {
 public:
   virtual ~ManagedLogger() = default;
@@ -19,25 +38,84 @@ public:
   virtual void warn(const std::string& message) const = 0;
   virtual void error(const std::string& message) const = 0;
   virtual void fatal(const std::string& message) const = 0;
+
+  // Rate-limited by the given site. The message is only built, by calling format(), if the site
+  // lets it through.
+  template <typename F>
+  void info(LogSite& site, const F& format) const {
+    log(&ManagedLogger::info, site, format);
+  }
+
+  template <typename F>
+  void warn(LogSite& site, const F& format) const {
+    log(&ManagedLogger::warn, site, format);
+  }
+
+  template <typename F>
+  void error(LogSite& site, const F& format) const {
+    log(&ManagedLogger::error, site, format);
+  }
+
+private:
+  template <typename F>
+  void log(void (ManagedLogger::*level)(const std::string&) const, LogSite& site,
+           const F& format) const {
+    std::uint64_t suppressed = 0;
+    if (!site.allow(suppressed)) {
+      return;
+    }
+    std::string message = format();
+    if (suppressed) {
+      message += " (" + std::to_string(suppressed) + " similar messages suppressed)";
+    }
+    (this->*level)(message);
+  }
 };
 
+// The logger, connection and update buffer can be used from any thread. Updates sent through the
+// buffer are merged per entity and component, and sent in one batch at the end of each frame.
+// Dispatcher callbacks should only be registered in init(); they always run on the managed loop
+// thread, never alongside tick() or sync().
 struct ManagedConnection {
   ManagedLogger& logger;
-  worker::Connection& connection;
+  Connection& connection;
+  UpdateBuffer& updates;
   worker::Dispatcher& dispatcher;
 };
 
+// State that a WorkerLogic's tick() and sync() share with other logic, identified by address. Logic
+// whose dependencies conflict (one writes something the other reads or writes) runs in the order
+// given to connect(); anything else may run at the same time on different threads.
+struct Dependencies {
+  // Run alone, with nothing else at the same time. The default for logic that declares nothing.
+  bool exclusive = true;
+  std::vector<const void*> reads;
+  std::vector<const void*> writes;
+};
+
 class WorkerLogic {
 public:
   virtual ~WorkerLogic() = default;
   virtual void init(ManagedConnection& connection) = 0;
   // Called every tick (60 times per second).
   virtual void tick() = 0;
-  // Called every sync (20 times per second).
+  // Called every sync (20 times per second, or less often if the worker is overloaded and the
+  // managed_max_ticks_per_sync worker flag allows it).
   virtual void sync() = 0;
+  // Called after a sync, never alongside tick() or sync(), to add the logic's own gauges to the
+  // load report sent for the worker.
+  virtual void report(worker::Metrics&) {}
+  // What tick() and sync() touch, other than the logic's own state and the connection.
+  virtual Dependencies dependencies() const {
+    return {};
+  }
 };
 
-// Parse standard command-line and connect.
+// Parse standard command-line and connect. Along with the load, each sync reports timing metrics
+// for op processing, each logic's tick and sync (numbered by position in the vector) and sleep
+// overshoot; see TickProfiler. Overruns are handled as described in TickScheduler. Logic runs on a
+// TaskPool with as many threads as the managed_threads worker flag allows (default: one per core).
+// Update buffer and logging statistics are reported too; see UpdateBuffer and AsyncLogger.
 int connect(const worker::ComponentRegistry& registry, const std::string& worker_type,
             const std::vector<WorkerLogic*>& logic, bool enable_protocol_logging, int argc,
             char** argv);
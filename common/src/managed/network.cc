@@ -0,0 +1,59 @@
+#include "common/src/managed/network.h"
+#include "common/src/managed/connection.h"
+#include <chrono>
+#include <cstdint>
+
+namespace gloam {
+namespace managed {
+namespace {
+// Longest the SDK waits for ops before returning an empty list. Sends queued meanwhile are flushed
+// once it returns, so this also bounds how long they wait to go out.
+const std::uint32_t kOpListTimeoutMillis = 2;
+// How often to retry handing over ops while the queue is full.
+const std::chrono::milliseconds kRetryInterval{1};
+// Op lists buffered before the network thread waits for the simulation thread to catch up.
+const std::size_t kQueueCapacity = 1024;
+}  // anonymous
+
+NetworkThread::NetworkThread(Connection& connection)
+: connection_(connection)
+, queue_{kQueueCapacity}
+, latency_phase_{profiler_.add_phase("network_op_latency")}
+, thread_{[this] { run(); }} {}
+
+NetworkThread::~NetworkThread() {
+  stop_ = true;
+  thread_.join();
+}
+
+void NetworkThread::process(worker::Dispatcher& dispatcher) {
+  std::unique_ptr<Ops> ops;
+  while (queue_.try_pop(ops)) {
+    profiler_.record(latency_phase_, TickProfiler::clock::now() - ops->received);
+    dispatcher.Process(ops->op_list);
+  }
+}
+
+void NetworkThread::report(worker::Metrics& metrics) {
+  profiler_.report(metrics);
+}
+
+void NetworkThread::run() {
+  while (!stop_) {
+    // Blocks until ops arrive or the timeout passes; only hand over (and time the latency of) lists
+    // with ops in them.
+    auto op_list = connection_.GetOpList(kOpListTimeoutMillis);
+    if (op_list.GetOpCount()) {
+      std::unique_ptr<Ops> ops{new Ops{std::move(op_list), TickProfiler::clock::now()}};
+      while (!stop_ && !queue_.try_push(std::move(ops))) {
+        connection_.flush();
+        std::this_thread::sleep_for(kRetryInterval);
+      }
+    }
+    connection_.flush();
+  }
+  connection_.flush();
+}
+
+}  // ::managed
+}  // ::gloam
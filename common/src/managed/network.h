@@ -0,0 +1,49 @@
+#ifndef GLOAM_COMMON_SRC_MANAGED_NETWORK_H
+#define GLOAM_COMMON_SRC_MANAGED_NETWORK_H
+#include "common/src/common/spsc_queue.h"
+#include "common/src/managed/profiler.h"
+#include <improbable/worker.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace gloam {
+namespace managed {
+class Connection;
+
+// Thread that does all the network work for a connection, so that SDK serialization and socket
+// latency stay off the tick. It waits for ops inside the SDK and hands any it gets to the
+// simulation thread through a lock-free queue, then flushes everything the connection has queued to
+// send, so sends go out at most one op list timeout late.
+class NetworkThread {
+public:
+  explicit NetworkThread(Connection& connection);
+  ~NetworkThread();
+
+  // Dispatches all ops received so far. Call from a single (simulation) thread only.
+  void process(worker::Dispatcher& dispatcher);
+  // Adds a histogram network_op_latency_ms, and gauges network_op_latency_mean_ms and
+  // network_op_latency_max_ms, for the time between ops arriving and being dispatched since the
+  // last report. Same thread as process() only.
+  void report(worker::Metrics& metrics);
+
+private:
+  struct Ops {
+    worker::OpList op_list;
+    TickProfiler::clock::time_point received;
+  };
+
+  void run();
+
+  Connection& connection_;
+  common::SpscQueue<std::unique_ptr<Ops>> queue_;
+  TickProfiler profiler_;
+  std::size_t latency_phase_;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+}  // ::managed
+}  // ::gloam
+
+#endif
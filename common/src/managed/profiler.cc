@@ -0,0 +1,39 @@
+#include "common/src/managed/profiler.h"
+#include <algorithm>
+
+namespace gloam {
+namespace managed {
+namespace {
+// Bucket upper bounds in milliseconds, up to a few ticks.
+const worker::List<double> kBucketBoundsMs = {0.05, 0.1, 0.25, 0.5, 1.,  2.,
+                                               4.,   8.,  12.,  17., 34., 68.};
+}  // anonymous
+
+std::size_t TickProfiler::add_phase(const std::string& name) {
+  phases_.push_back({name, worker::HistogramMetric{kBucketBoundsMs}, 0, 0., 0.});
+  return phases_.size() - 1;
+}
+
+void TickProfiler::record(std::size_t phase, clock::duration duration) {
+  auto ms = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(duration).count();
+  auto& p = phases_[phase];
+  p.histogram.RecordObservation(ms);
+  ++p.samples;
+  p.total_ms += ms;
+  p.max_ms = std::max(p.max_ms, ms);
+}
+
+void TickProfiler::report(worker::Metrics& metrics) {
+  for (auto& p : phases_) {
+    metrics.HistogramMetrics.emplace(p.name + "_ms", p.histogram);
+    metrics.GaugeMetrics[p.name + "_mean_ms"] = p.samples ? p.total_ms / p.samples : 0.;
+    metrics.GaugeMetrics[p.name + "_max_ms"] = p.max_ms;
+    p.histogram.ClearObservations();
+    p.samples = 0;
+    p.total_ms = 0.;
+    p.max_ms = 0.;
+  }
+}
+
+}  // ::managed
+}  // ::gloam
@@ -0,0 +1,40 @@
+#ifndef GLOAM_COMMON_SRC_MANAGED_PROFILER_H
+#define GLOAM_COMMON_SRC_MANAGED_PROFILER_H
+#include <improbable/worker.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gloam {
+namespace managed {
+
+// Records how long each phase of the managed loop takes into fixed-bucket histograms, and exports
+// them as worker metrics.
+class TickProfiler {
+public:
+  using clock = std::chrono::steady_clock;
+
+  // Adds a phase with the given (stable) metric name. Returns the index to record it under.
+  std::size_t add_phase(const std::string& name);
+  void record(std::size_t phase, clock::duration duration);
+
+  // For each phase, adds a histogram <name>_ms and gauges <name>_mean_ms and <name>_max_ms covering
+  // everything recorded since the last report.
+  void report(worker::Metrics& metrics);
+
+private:
+  struct Phase {
+    std::string name;
+    worker::HistogramMetric histogram;
+    std::uint32_t samples;
+    double total_ms;
+    double max_ms;
+  };
+  std::vector<Phase> phases_;
+};
+
+}  // ::managed
+}  // ::gloam
+
+#endif
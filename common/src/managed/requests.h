@@ -0,0 +1,153 @@
+#ifndef GLOAM_COMMON_SRC_MANAGED_REQUESTS_H
+#define GLOAM_COMMON_SRC_MANAGED_REQUESTS_H
+#include "common/src/common/flat_map.h"
+#include "common/src/common/hashes.h"
+#include <improbable/worker.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gloam {
+namespace managed {
+
+// Tracks requests of one type sent on behalf of keys (say, one entity creation per chunk), with at
+// most one request in flight per key. Responses are matched back to their key in constant time.
+// Failed requests back off exponentially before the key is ready to retry, and the total number
+// of requests in flight is limited. Not thread-safe.
+template <typename Key, typename RequestT, typename Hash = common::mixing_hash<Key>>
+class RequestTracker {
+public:
+  using clock = std::chrono::steady_clock;
+  using RequestId = worker::RequestId<RequestT>;
+
+  struct Policy {
+    // Most requests in flight at once, over all keys.
+    std::size_t max_in_flight = 64;
+    // Passed to the SDK with each request. Requests still without a response after twice this
+    // long (for example, if the response was lost) are given up on by expire().
+    std::chrono::milliseconds timeout{10000};
+    // Wait before retrying a key after its first failure, doubling with each further failure.
+    clock::duration min_backoff = std::chrono::milliseconds{250};
+    clock::duration max_backoff = std::chrono::seconds{30};
+  };
+
+  RequestTracker() : RequestTracker{Policy{}} {}
+  explicit RequestTracker(const Policy& policy) : policy_(policy) {}
+
+  // Timeout to send the request with.
+  worker::Option<std::uint32_t> timeout_millis() const {
+    return {static_cast<std::uint32_t>(policy_.timeout.count())};
+  }
+
+  std::size_t in_flight() const {
+    return requests_.size();
+  }
+
+  bool in_flight(const Key& key) const {
+    auto it = keys_.find(key);
+    return it != keys_.end() && it->second.request_id.Id;
+  }
+
+  // Whether a request can be sent for the key now: none is in flight for it, nor too many in
+  // total, and any backoff from earlier failures has passed.
+  bool ready(const Key& key, clock::time_point now) const {
+    if (requests_.size() >= policy_.max_in_flight) {
+      return false;
+    }
+    auto it = keys_.find(key);
+    return it == keys_.end() || (!it->second.request_id.Id && now >= it->second.retry_time);
+  }
+
+  void sent(const Key& key, RequestId request_id, clock::time_point now) {
+    auto& state = keys_[key];
+    if (state.request_id.Id) {
+      requests_.erase(state.request_id.Id);
+    }
+    state.request_id = request_id;
+    requests_.emplace(request_id.Id, Request{key, now});
+  }
+
+  // Finds the key for a response, and stops tracking the request. A failure backs the key off;
+  // a success resets it. Returns false if the response doesn't match a tracked request.
+  bool complete(RequestId request_id, worker::StatusCode status, clock::time_point now, Key& key) {
+    auto it = requests_.find(request_id.Id);
+    if (it == requests_.end()) {
+      return false;
+    }
+    key = it->second.key;
+    requests_.erase(request_id.Id);
+    if (status == worker::StatusCode::kSuccess) {
+      keys_.erase(key);
+    } else {
+      back_off(key, now);
+    }
+    return true;
+  }
+
+  // Gives up on requests that have gone unanswered for too long, backing their keys off, and calls
+  // on_expired(key) for each. Late responses to them are then ignored by complete().
+  template <typename F>
+  void expire(clock::time_point now, const F& on_expired) {
+    expired_.clear();
+    for (const auto& pair : requests_) {
+      if (now - pair.second.sent_time >= 2 * policy_.timeout) {
+        expired_.push_back(pair.first);
+      }
+    }
+    for (auto id : expired_) {
+      auto key = requests_.find(id)->second.key;
+      requests_.erase(id);
+      back_off(key, now);
+      on_expired(key);
+    }
+  }
+
+  // Forgets everything about the key. A response to its request in flight, if any, is ignored.
+  void erase(const Key& key) {
+    auto it = keys_.find(key);
+    if (it == keys_.end()) {
+      return;
+    }
+    if (it->second.request_id.Id) {
+      requests_.erase(it->second.request_id.Id);
+    }
+    keys_.erase(key);
+  }
+
+private:
+  using Id = decltype(RequestId::Id);
+
+  struct Request {
+    Key key;
+    clock::time_point sent_time;
+  };
+
+  struct KeyState {
+    RequestId request_id;
+    std::uint32_t failures = 0;
+    clock::time_point retry_time;
+  };
+
+  void back_off(const Key& key, clock::time_point now) {
+    auto& state = keys_[key];
+    state.request_id = {};
+    auto backoff = policy_.min_backoff;
+    for (std::uint32_t i = 0; i < state.failures && backoff < policy_.max_backoff; ++i) {
+      backoff *= 2;
+    }
+    state.retry_time = now + std::min(backoff, policy_.max_backoff);
+    ++state.failures;
+  }
+
+  Policy policy_;
+  common::FlatMap<Id, Request> requests_;
+  common::FlatMap<Key, KeyState, Hash> keys_;
+  std::vector<Id> expired_;
+};
+
+}  // ::managed
+}  // ::gloam
+
+#endif
@@ -0,0 +1,85 @@
+#include "common/src/managed/scheduler.h"
+#include <improbable/worker.h>
+#include <algorithm>
+#include <thread>
+
+namespace gloam {
+namespace managed {
+namespace {
+// Weight of each tick in the load average.
+const float kLoadSmoothing = 1.f / 32;
+// Ticks to wait between sync rate changes, so the load average can catch up with each one.
+const std::uint32_t kRateChangeTicks = 64;
+
+const TickScheduler::clock::duration kTick =
+    std::chrono::duration_cast<TickScheduler::clock::duration>(common::kTickDuration);
+}  // anonymous
+
+TickScheduler::TickScheduler(const Policy& policy, clock::time_point start)
+: policy_{policy}, next_tick_{start} {
+  policy_.ticks_per_sync = std::max(1u, policy_.ticks_per_sync);
+  policy_.max_ticks_per_sync = std::max(policy_.ticks_per_sync, policy_.max_ticks_per_sync);
+  ticks_per_sync_ = policy_.ticks_per_sync;
+}
+
+bool TickScheduler::sync_due() const {
+  return !sync_counter_;
+}
+
+void TickScheduler::end_tick(clock::time_point work_start) {
+  auto load = std::chrono::duration<float>(clock::now() - work_start) /
+      std::chrono::duration<float>(kTick);
+  load_average_ += kLoadSmoothing * (load - load_average_);
+  ++ticks_since_rate_change_;
+  if (++sync_counter_ < ticks_per_sync_) {
+    return;
+  }
+  sync_counter_ = 0;
+
+  // Only change the sync rate between syncs.
+  if (ticks_since_rate_change_ < kRateChangeTicks) {
+    return;
+  }
+  if (load_average_ > policy_.degrade_load && ticks_per_sync_ < policy_.max_ticks_per_sync) {
+    ++ticks_per_sync_;
+    ticks_since_rate_change_ = 0;
+  } else if (load_average_ < policy_.recover_load && ticks_per_sync_ > policy_.ticks_per_sync) {
+    --ticks_per_sync_;
+    ticks_since_rate_change_ = 0;
+  }
+}
+
+TickScheduler::clock::duration TickScheduler::wait() {
+  next_tick_ += kTick;
+  auto now = clock::now();
+  if (now > next_tick_) {
+    // Run the next tick straight away, but don't try to make up more than the catch-up budget.
+    auto behind = static_cast<std::uint64_t>((now - next_tick_) / kTick);
+    if (behind > policy_.max_catch_up_ticks) {
+      auto dropped = behind - policy_.max_catch_up_ticks;
+      next_tick_ += static_cast<clock::rep>(dropped) * kTick;
+      dropped_ticks_ += dropped;
+    }
+    ++late_ticks_;
+    return clock::duration::zero();
+  }
+  std::this_thread::sleep_until(next_tick_);
+  return std::max(clock::duration::zero(), clock::now() - next_tick_);
+}
+
+std::uint32_t TickScheduler::ticks_per_sync() const {
+  return ticks_per_sync_;
+}
+
+void TickScheduler::report(worker::Metrics& metrics) {
+  auto tick_seconds = std::chrono::duration<double>(kTick).count();
+  metrics.GaugeMetrics["managed_sync_rate_hz"] = 1. / (tick_seconds * ticks_per_sync_);
+  metrics.GaugeMetrics["managed_load_average"] = load_average_;
+  metrics.GaugeMetrics["managed_late_ticks"] = static_cast<double>(late_ticks_);
+  metrics.GaugeMetrics["managed_dropped_ticks"] = static_cast<double>(dropped_ticks_);
+  late_ticks_ = 0;
+  dropped_ticks_ = 0;
+}
+
+}  // ::managed
+}  // ::gloam
@@ -0,0 +1,65 @@
+#ifndef GLOAM_COMMON_SRC_MANAGED_SCHEDULER_H
+#define GLOAM_COMMON_SRC_MANAGED_SCHEDULER_H
+#include "common/src/common/timing.h"
+#include <chrono>
+#include <cstdint>
+
+namespace worker {
+struct Metrics;
+}  // ::worker
+
+namespace gloam {
+namespace managed {
+
+// Decides when the managed loop runs ticks and syncs, and what happens when ticks overrun. After
+// an overrun, a bounded number of ticks run back-to-back to catch up and any beyond that are
+// dropped. Optionally, the sync rate is lowered while load stays high and raised again once it
+// recovers.
+class TickScheduler {
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct Policy {
+    // Most ticks to run back-to-back to catch up; further missed ticks are dropped.
+    std::uint32_t max_catch_up_ticks = 3;
+    // Sync every this many ticks when not overloaded.
+    std::uint32_t ticks_per_sync = common::kTicksPerSync;
+    // Most ticks per sync under sustained load. Equal to ticks_per_sync to disable degradation.
+    std::uint32_t max_ticks_per_sync = common::kTicksPerSync;
+    // Averaged load (fraction of the tick duration spent working) above which the sync rate is
+    // lowered, and below which it is raised again.
+    float degrade_load = .9f;
+    float recover_load = .6f;
+  };
+
+  TickScheduler(const Policy& policy, clock::time_point start);
+
+  // Whether the tick about to run should also sync.
+  bool sync_due() const;
+  // Call after each tick's work with the time the work started.
+  void end_tick(clock::time_point work_start);
+  // Sleeps until the next tick is due, dropping ticks if too far behind. Returns how late it woke,
+  // or zero if the next tick was already due and it didn't sleep.
+  clock::duration wait();
+
+  std::uint32_t ticks_per_sync() const;
+  // Adds gauges for the sync rate, averaged load, ticks started late (straight after the previous
+  // one, without sleeping) and ticks dropped since the last call.
+  void report(worker::Metrics& metrics);
+
+private:
+  Policy policy_;
+  clock::time_point next_tick_;
+  std::uint32_t ticks_per_sync_;
+  std::uint32_t sync_counter_ = 0;
+  std::uint32_t ticks_since_rate_change_ = 0;
+  float load_average_ = 0.f;
+
+  std::uint64_t late_ticks_ = 0;
+  std::uint64_t dropped_ticks_ = 0;
+};
+
+}  // ::managed
+}  // ::gloam
+
+#endif
@@ -0,0 +1,166 @@
+#include "common/src/managed/task_pool.h"
+#include <algorithm>
+
+namespace gloam {
+namespace managed {
+
+TaskPool::TaskPool(std::size_t threads) {
+  threads = std::max(std::size_t{1}, threads);
+  for (std::size_t i = 0; i < threads; ++i) {
+    queues_.emplace_back(new Queue);
+  }
+  for (std::size_t i = 1; i < threads; ++i) {
+    threads_.emplace_back([this, i] { worker(i); });
+  }
+}
+
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+std::size_t TaskPool::threads() const {
+  return queues_.size();
+}
+
+void TaskPool::run(const std::vector<Task>& tasks) {
+  if (tasks.empty()) {
+    return;
+  }
+  if (pending_size_ < tasks.size()) {
+    pending_.reset(new std::atomic<std::size_t>[tasks.size()]);
+    pending_size_ = tasks.size();
+  }
+  for (std::size_t i = 0; i < tasks.size(); ++i) {
+    pending_[i] = 0;
+  }
+  for (const auto& task : tasks) {
+    for (auto successor : task.successors) {
+      ++pending_[successor];
+    }
+  }
+  tasks_ = &tasks;
+  remaining_ = tasks.size();
+  std::size_t next_queue = 0;
+  for (std::size_t i = 0; i < tasks.size(); ++i) {
+    if (!pending_[i]) {
+      push(next_queue, i);
+      next_queue = (1 + next_queue) % queues_.size();
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    ++run_;
+    finished_ = 0;
+  }
+  start_.notify_all();
+  work(0);
+
+  // Pool threads may still be looking at the run state until they check in.
+  std::unique_lock<std::mutex> lock{mutex_};
+  done_.wait(lock, [&] { return finished_ == threads_.size(); });
+  tasks_ = nullptr;
+}
+
+void TaskPool::worker(std::size_t index) {
+  std::uint64_t run = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      start_.wait(lock, [&] { return stop_ || run_ != run; });
+      if (stop_) {
+        return;
+      }
+      run = run_;
+    }
+    work(index);
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      ++finished_;
+    }
+    done_.notify_one();
+  }
+}
+
+void TaskPool::work(std::size_t index) {
+  while (remaining_) {
+    std::size_t task;
+    if (!pop(index, task)) {
+      // Nothing ready: the remaining tasks are running elsewhere or waiting on ones that are.
+      std::unique_lock<std::mutex> lock{idle_mutex_};
+      ++sleeping_;
+      idle_.wait(lock, [&] { return !remaining_ || queued_; });
+      --sleeping_;
+      continue;
+    }
+    const auto& t = (*tasks_)[task];
+    t.f();
+    for (auto successor : t.successors) {
+      if (!--pending_[successor]) {
+        push(index, successor);
+      }
+    }
+    if (!--remaining_) {
+      wake(true);
+    }
+  }
+}
+
+void TaskPool::push(std::size_t index, std::size_t task) {
+  auto& queue = *queues_[index];
+  // Counted before it's visible, so pop() never takes the count below zero.
+  ++queued_;
+  {
+    std::lock_guard<std::mutex> lock{queue.mutex};
+    queue.tasks.push_back(task);
+  }
+  wake(false);
+}
+
+void TaskPool::wake(bool all) {
+  // Sleepers count themselves before checking for work, so either they see the new task or the
+  // run finishing, or we see them here.
+  if (!sleeping_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{idle_mutex_};
+  if (all) {
+    idle_.notify_all();
+  } else {
+    idle_.notify_one();
+  }
+}
+
+bool TaskPool::pop(std::size_t index, std::size_t& task) {
+  {
+    auto& queue = *queues_[index];
+    std::lock_guard<std::mutex> lock{queue.mutex};
+    if (!queue.tasks.empty()) {
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+      --queued_;
+      return true;
+    }
+  }
+  for (std::size_t i = 1; i < queues_.size(); ++i) {
+    auto& queue = *queues_[(index + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock{queue.mutex};
+    if (!queue.tasks.empty()) {
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+      --queued_;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // ::managed
+}  // ::gloam
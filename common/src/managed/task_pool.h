@@ -0,0 +1,105 @@
+#ifndef GLOAM_COMMON_SRC_MANAGED_TASK_POOL_H
+#define GLOAM_COMMON_SRC_MANAGED_TASK_POOL_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gloam {
+namespace managed {
+
+// Persistent work-stealing thread pool for running a small graph of dependent tasks, over and
+// over. Each thread has its own deque of ready tasks: it pushes and pops at the back, and steals
+// from the front of the others' when its own is empty. A task that becomes ready is pushed onto
+// the deque of the thread that finished its last dependency, so chains tend to stay on one thread.
+// Threads with nothing to do sleep until a task is pushed or the run finishes.
+class TaskPool {
+public:
+  struct Task {
+    std::function<void()> f;
+    // Indices of tasks that can't start until this one has finished.
+    std::vector<std::size_t> successors;
+  };
+
+  // Total number of threads, including the one calling run().
+  explicit TaskPool(std::size_t threads);
+  ~TaskPool();
+
+  std::size_t threads() const;
+  // Runs every task, respecting dependencies, and returns once they have all finished. The graph
+  // must be acyclic.
+  void run(const std::vector<Task>& tasks);
+
+  // Calls f(i) once for each i < count, spread across the pool, and returns once all calls have
+  // finished. Indices are handed out one at a time, so uneven work balances itself; the order in
+  // which calls run is unspecified.
+  template <typename F>
+  void parallel_for(std::size_t count, const F& f) {
+    struct State {
+      std::atomic<std::size_t> next;
+      std::size_t count;
+      const F& f;
+    } state{{0}, count, f};
+    // Capturing a single pointer keeps the std::function from allocating.
+    auto* s = &state;
+    loop_tasks_.resize(std::min(threads(), count));
+    for (auto& task : loop_tasks_) {
+      task.f = [s] {
+        for (auto i = s->next++; i < s->count; i = s->next++) {
+          s->f(i);
+        }
+      };
+    }
+    run(loop_tasks_);
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::size_t> tasks;
+  };
+
+  void worker(std::size_t index);
+  void work(std::size_t index);
+  void push(std::size_t index, std::size_t task);
+  // Wakes one sleeping thread for a new task, or all of them once the run has finished.
+  void wake(bool all);
+  bool pop(std::size_t index, std::size_t& task);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<Task> loop_tasks_;
+  std::vector<std::thread> threads_;
+
+  // State for the current run.
+  const std::vector<Task>* tasks_ = nullptr;
+  std::unique_ptr<std::atomic<std::size_t>[]> pending_;
+  std::size_t pending_size_ = 0;
+  std::atomic<std::size_t> remaining_{0};
+
+  // Parks threads that find every deque empty during a run. Pushers only take the mutex to wake
+  // them when someone is asleep.
+  std::mutex idle_mutex_;
+  std::condition_variable idle_;
+  std::atomic<std::size_t> queued_{0};
+  std::atomic<std::size_t> sleeping_{0};
+
+  // Wakes pool threads for each run, and tells the caller when they're all done with it.
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  std::uint64_t run_ = 0;
+  std::size_t finished_ = 0;
+  bool stop_ = false;
+};
+
+}  // ::managed
+}  // ::gloam
+
+#endif
@@ -0,0 +1,37 @@
+#include "common/src/managed/updates.h"
+
+namespace gloam {
+namespace managed {
+
+void UpdateBuffer::flush(Connection& connection) {
+  std::shared_ptr<std::vector<std::unique_ptr<Pending>>> batch{
+      new std::vector<std::unique_ptr<Pending>>};
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (pending_.empty()) {
+      return;
+    }
+    batch->swap(pending_);
+    index_.clear();
+    sent_ += batch->size();
+    ++batches_;
+  }
+  connection.queue([batch](worker::Connection& c) {
+    for (const auto& pending : *batch) {
+      pending->send(c);
+    }
+  });
+}
+
+void UpdateBuffer::report(worker::Metrics& metrics) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  metrics.GaugeMetrics["managed_updates"] = static_cast<double>(updates_);
+  metrics.GaugeMetrics["managed_updates_sent"] = static_cast<double>(sent_);
+  metrics.GaugeMetrics["managed_update_batches"] = static_cast<double>(batches_);
+  updates_ = 0;
+  sent_ = 0;
+  batches_ = 0;
+}
+
+}  // ::managed
+}  // ::gloam
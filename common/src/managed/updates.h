@@ -0,0 +1,92 @@
+#ifndef GLOAM_COMMON_SRC_MANAGED_UPDATES_H
+#define GLOAM_COMMON_SRC_MANAGED_UPDATES_H
+#include "common/src/common/flat_map.h"
+#include "common/src/common/hashes.h"
+#include "common/src/managed/connection.h"
+#include <improbable/worker.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace gloam {
+namespace common {
+// Specialized for each component in common/src/common/update_merge.h.
+template <typename T>
+struct UpdateMerge;
+}  // ::common
+
+namespace managed {
+
+// Buffers component updates until the end of the frame, merging updates to the same component of
+// the same entity: fields set later win and events are appended. Everything is then queued on the
+// connection as a single batch. Safe to use from several threads. The merge for each component
+// comes from common::UpdateMerge, so senders need to include common/src/common/update_merge.h.
+//
+// Updates are sent in the order each entity and component was first updated in the frame, and
+// after anything sent directly on the connection during the frame.
+class UpdateBuffer {
+public:
+  template <typename T>
+  void SendComponentUpdate(worker::EntityId entity_id, const typename T::Update& update) {
+    worker::ComponentId component_id = T::ComponentId;
+    Key key{entity_id, component_id};
+    std::lock_guard<std::mutex> lock{mutex_};
+    ++updates_;
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      auto& pending = static_cast<PendingUpdate<T>&>(*pending_[it->second]);
+      common::UpdateMerge<T>::merge(pending.update, update);
+      return;
+    }
+    index_.emplace(key, pending_.size());
+    pending_.emplace_back(new PendingUpdate<T>{entity_id, update});
+  }
+
+  // Queues everything buffered so far on the connection.
+  void flush(Connection& connection);
+  // Adds gauges managed_updates (updates given to the buffer), managed_updates_sent (after
+  // merging) and managed_update_batches since the last report.
+  void report(worker::Metrics& metrics);
+
+private:
+  struct Pending {
+    virtual ~Pending() = default;
+    virtual void send(worker::Connection& connection) const = 0;
+  };
+
+  template <typename T>
+  struct PendingUpdate : Pending {
+    PendingUpdate(worker::EntityId entity_id, const typename T::Update& update)
+    : entity_id{entity_id}, update(update) {}
+
+    void send(worker::Connection& connection) const override {
+      connection.SendComponentUpdate<T>(entity_id, update);
+    }
+
+    worker::EntityId entity_id;
+    typename T::Update update;
+  };
+
+  using Key = std::pair<worker::EntityId, worker::ComponentId>;
+  struct KeyHash {
+    std::size_t operator()(const Key& key) const {
+      return static_cast<std::size_t>(
+          common::mix_bits(common::mix_bits(static_cast<std::uint64_t>(key.first)) ^ key.second));
+    }
+  };
+
+  std::mutex mutex_;
+  common::FlatMap<Key, std::size_t, KeyHash> index_;
+  std::vector<std::unique_ptr<Pending>> pending_;
+
+  std::uint64_t updates_ = 0;
+  std::uint64_t sent_ = 0;
+  std::uint64_t batches_ = 0;
+};
+
+}  // ::managed
+}  // ::gloam
+
+#endif
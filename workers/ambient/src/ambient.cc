@@ -1,9 +1,13 @@
 #include "common/src/common/conversions.h"
+#include "common/src/common/flat_map.h"
 #include "common/src/common/math.h"
+#include "common/src/common/parallel.h"
 #include "common/src/common/timing.h"
+#include "common/src/common/update_merge.h"
 #include "common/src/core/collision.h"
 #include "common/src/core/tile_map.h"
 #include "common/src/managed/managed.h"
+#include "common/src/managed/task_pool.h"
 #include <glm/glm.hpp>
 #include <improbable/worker.h>
 #include <schema/chunk.h>
@@ -11,7 +15,7 @@
 #include <schema/player.h>
 #include <algorithm>
 #include <cstdint>
-#include <unordered_map>
+#include <vector>
 
 namespace gloam {
 namespace ambient {
@@ -20,7 +24,9 @@ const std::string kWorkerType = "ambient";
 
 class PositionLogic : public managed::WorkerLogic {
 public:
-  PositionLogic() : collision_{tile_map_} {}
+  PositionLogic()
+  : collision_pool_{std::max<std::size_t>(1, common::hardware_threads() / 2)}
+  , collision_{tile_map_, &collision_pool_} {}
 
   void init(managed::ManagedConnection& c) override {
     c_ = &c;
@@ -84,6 +90,32 @@ public:
   }
 
   void sync() override {
+    core::Box box{1.f / 8};
+
+    // Move all the players together, so that nearby players share collision lookups.
+    moving_positions_.clear();
+    batch_boxes_.clear();
+    batch_positions_.clear();
+    batch_projections_.clear();
+    batch_caches_.clear();
+    for (auto& pair : entity_positions_) {
+      auto& position = pair.second;
+      if (position.has_authority && position.xz_dv != glm::vec2{}) {
+        moving_positions_.push_back(&position);
+        batch_boxes_.push_back(box);
+        batch_positions_.push_back(position.current);
+        batch_projections_.push_back(common::kPlayerSpeed * position.xz_dv);
+        batch_caches_.push_back(&position.collision_cache);
+      }
+    }
+    batch_results_.resize(moving_positions_.size());
+    collision_.project_xz(moving_positions_.size(), batch_boxes_.data(), batch_positions_.data(),
+                          batch_projections_.data(), batch_results_.data(), collision_context_,
+                          batch_caches_.data());
+    for (std::size_t i = 0; i < moving_positions_.size(); ++i) {
+      moving_positions_[i]->current += common::from_xz(batch_results_[i], 0.f);
+    }
+
     for (auto& pair : entity_positions_) {
       auto& position = pair.second;
       if (!position.has_authority) {
@@ -91,35 +123,42 @@ public:
       }
 
       auto& current = position.current;
-      core::Box box{1.f / 8};
-      if (position.xz_dv != glm::vec2{}) {
-        auto projection_xz =
-            collision_.project_xz(box, current, common::kPlayerSpeed * position.xz_dv);
-        current += common::from_xz(projection_xz, 0.f);
-      }
       current.y -= common::kGravity;
       current.y = collision_.terrain_height(box, current);
 
       // Bounce back to client (and cosimulators) for this player.
-      c_->connection.SendComponentUpdate<schema::PlayerServer>(
+      c_->updates.SendComponentUpdate<schema::PlayerServer>(
           pair.first, schema::PlayerServer::Update{}.add_sync_state(
                           {position.player_tick, current.x, current.y, current.z}));
       // Update the canonical position and send interpolation. Make sure to duplicate the final
       // position in case the client is extrapolating.
       if (current != position.last || position.moving) {
-        c_->connection.SendComponentUpdate<schema::InterpolatedPosition>(
+        c_->updates.SendComponentUpdate<schema::InterpolatedPosition>(
             pair.first,
             schema::InterpolatedPosition::Update{}.add_position({current.x, current.y, current.z}));
       }
 
       position.moving = current != position.last;
       if (position.moving) {
-        c_->connection.SendComponentUpdate<improbable::Position>(
+        c_->updates.SendComponentUpdate<improbable::Position>(
             pair.first, improbable::Position::Update{}.set_coords(common::coords(current)));
       }
       position.last = current;
       ++position.player_tick;
     }
+
+    // Keep the chunks around our players loaded.
+    residency_focus_.clear();
+    for (const auto& pair : entity_positions_) {
+      if (pair.second.has_authority) {
+        residency_focus_.push_back(common::get_xz(pair.second.current));
+      }
+    }
+    tile_map_.update_residency(residency_focus_);
+  }
+
+  void report(worker::Metrics& metrics) override {
+    tile_map_.add_metrics("tile_map_", metrics);
   }
 
 private:
@@ -130,12 +169,27 @@ private:
     glm::vec3 last;
     glm::vec3 current;
     std::uint32_t player_tick;
+    core::Collision::Cache collision_cache;
   };
 
   managed::ManagedConnection* c_ = nullptr;
   core::TileMap tile_map_;
+  // Threads for extracting collision when many chunks change at once, owned by this logic. They
+  // sleep otherwise, and are capped at half the cores since the managed loop's own pool runs other
+  // logic alongside.
+  managed::TaskPool collision_pool_;
   core::Collision collision_;
-  std::unordered_map<worker::EntityId, Position> entity_positions_;
+  core::Collision::Context collision_context_;
+  common::FlatMap<worker::EntityId, Position> entity_positions_;
+
+  // Batched collision queries for the current sync.
+  std::vector<Position*> moving_positions_;
+  std::vector<core::Box> batch_boxes_;
+  std::vector<glm::vec3> batch_positions_;
+  std::vector<glm::vec2> batch_projections_;
+  std::vector<core::Collision::Cache*> batch_caches_;
+  std::vector<glm::vec2> batch_results_;
+  std::vector<glm::vec2> residency_focus_;
 };
 
 }  // anonymous
@@ -1,5 +1,7 @@
 #include "workers/client/src/connect_mode.h"
 #include "common/src/common/definitions.h"
+#include "common/src/managed/connection.h"
+#include "common/src/managed/network.h"
 #include "workers/client/src/components.h"
 #include "workers/client/src/input.h"
 #include "workers/client/src/renderer.h"
@@ -21,6 +23,7 @@ ConnectMode::ConnectMode(ModeState& mode_state, const std::string& disconnect_re
 ConnectMode::ConnectMode(ModeState& mode_state, worker::Connection&& connection)
 : mode_state_{mode_state}
 , connection_{new worker::Connection{std::move(connection)}}
+, shared_connection_{new managed::Connection{*connection_}}
 , dispatcher_{ClientComponents()} {
   dispatcher_.OnDisconnect([this](const worker::DisconnectOp& op) {
     std::cerr << "[disconnected] " << op.Reason << std::endl;
@@ -52,7 +55,7 @@ ConnectMode::ConnectMode(ModeState& mode_state, worker::Connection&& connection)
 
   dispatcher_.OnMetrics([this](const worker::MetricsOp& op) {
     auto metrics = op.Metrics;
-    connection_->SendMetrics(metrics);
+    shared_connection_->SendMetrics(metrics);
   });
 
   dispatcher_.OnCommandResponse<schema::Master::Commands::ClientHeartbeat>(
@@ -76,23 +79,30 @@ ConnectMode::ConnectMode(ModeState& mode_state, worker::Connection&& connection)
   dispatcher_.OnComponentUpdate<schema::PlayerServer>(
       [&](const worker::ComponentUpdateOp<schema::PlayerServer>&) { have_stream_ = true; });
 
-  if (!connection_->IsConnected()) {
+  // Ops are only dispatched from tick(), so the thread can start before the callbacks are all set
+  // up.
+  network_.reset(new managed::NetworkThread{*shared_connection_});
+  if (!shared_connection_->IsConnected()) {
     return;
   }
-  connection_->SendLogMessage(worker::LogLevel::kInfo, "client", "Connected.");
-  world_.reset(new world::PlayerController{*connection_, dispatcher_, mode_state_});
+  shared_connection_->SendLogMessage(worker::LogLevel::kInfo, "client", "Connected.");
+  world_.reset(new world::PlayerController{*shared_connection_, dispatcher_, mode_state_});
 }
 
+// Members are destroyed in reverse order, so the network thread stops (sending anything left)
+// before the connection goes away.
+ConnectMode::~ConnectMode() = default;
+
 void ConnectMode::tick(const Input& input) {
   if (!connected_ && input.pressed(Button::kAnyKey)) {
     disconnect_ack_ = true;
   }
   if (connected_) {
-    dispatcher_.Process(connection_->GetOpList(/* millis */ 0));
+    network_->process(dispatcher_);
 
     // Send heartbeat periodically to master.
     if (frame_++ % 256 == 0) {
-      connection_->SendCommandRequest<schema::Master::Commands::ClientHeartbeat>(
+      shared_connection_->SendCommandRequest<schema::Master::Commands::ClientHeartbeat>(
           /* master entity */ common::kMasterSeedEntityId, {player_entity_id_}, {});
     }
     if (have_stream_ && frame_ % 64 == 0 && !logged_in_) {
@@ -119,7 +129,9 @@ void ConnectMode::sync() {
     // Send metrics for the inspector.
     worker::Metrics client_metrics;
     client_metrics.GaugeMetrics[kClientLoadMetric] = mode_state_.client_load;
-    connection_->SendMetrics(client_metrics);
+    network_->report(client_metrics);
+    world_->report(client_metrics);
+    shared_connection_->SendMetrics(client_metrics);
   }
 }
 
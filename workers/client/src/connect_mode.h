@@ -8,6 +8,10 @@
 
 namespace gloam {
 class Renderer;
+namespace managed {
+class Connection;
+class NetworkThread;
+}  // ::managed
 namespace world {
 class PlayerController;
 }  // ::world
@@ -16,6 +20,7 @@ class ConnectMode : public Mode {
 public:
   ConnectMode(ModeState& mode_state, const std::string& disconnect_reason);
   ConnectMode(ModeState& mode_state, worker::Connection&& connection);
+  ~ConnectMode();
   void tick(const Input& input) override;
   void sync() override;
   void render(const Renderer& renderer) const override;
@@ -27,6 +32,8 @@ private:
   std::string disconnect_reason_;
 
   std::unique_ptr<worker::Connection> connection_;
+  std::unique_ptr<managed::Connection> shared_connection_;
+  std::unique_ptr<managed::NetworkThread> network_;
   worker::Dispatcher dispatcher_;
 
   worker::Option<worker::EntityId> player_entity_id_;
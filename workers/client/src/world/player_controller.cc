@@ -1,6 +1,7 @@
 #include "workers/client/src/world/player_controller.h"
 #include "common/src/common/conversions.h"
 #include "common/src/common/math.h"
+#include "common/src/common/parallel.h"
 #include "common/src/common/timing.h"
 #include "workers/client/src/input.h"
 #include <glm/glm.hpp>
@@ -36,11 +37,12 @@ void interpolate(T& from, const T& to, bool is_moving) {
 }
 }  // anonymous namespace
 
-PlayerController::PlayerController(worker::Connection& connection, worker::Dispatcher& dispatcher,
-                                   const ModeState& mode_state)
+PlayerController::PlayerController(managed::Connection& connection,
+                                   worker::Dispatcher& dispatcher, const ModeState& mode_state)
 : connection_{connection}
 , dispatcher_{dispatcher}
-, collision_{tile_map_}
+, collision_pool_{common::hardware_threads()}
+, collision_{tile_map_, &collision_pool_}
 , world_renderer_{mode_state} {
   dispatcher_.OnAddEntity([&](const worker::AddEntityOp& op) {
     connection_.SendComponentInterest(op.EntityId,
@@ -141,7 +143,8 @@ void PlayerController::tick(const Input& input) {
   core::Box box{1.f / 8};
   if (is_moving) {
     direction = glm::normalize(direction);
-    auto projection_xz = collision_.project_xz(box, local_position_, speed_per_tick * direction);
+    auto projection_xz =
+        collision_.project_xz(box, local_position_, speed_per_tick * direction, local_cache_);
 
     local_position_ += common::from_xz(projection_xz, 0.f);
     canonical_position_ += common::from_xz(projection_xz, 0.f);
@@ -186,6 +189,12 @@ void PlayerController::sync() {
     input_history_.pop_front();
   }
   player_tick_dv_ = {};
+
+  tile_map_.update_residency({common::get_xz(local_position_)});
+}
+
+void PlayerController::report(worker::Metrics& metrics) const {
+  tile_map_.add_metrics("tile_map_", metrics);
 }
 
 void PlayerController::render(const Renderer& renderer, std::uint64_t frame) const {
@@ -212,7 +221,7 @@ void PlayerController::render(const Renderer& renderer, std::uint64_t frame) con
     }
   }
 
-  world_renderer_.render(renderer, frame, local_position_, lights, positions, tile_map_.get());
+  world_renderer_.render(renderer, frame, local_position_, lights, positions, tile_map_);
 }
 
 void PlayerController::reconcile(std::uint32_t sync_tick, const glm::vec3& coordinates) {
@@ -235,8 +244,8 @@ void PlayerController::reconcile(std::uint32_t sync_tick, const glm::vec3& coord
   }
   for (const auto& input : input_history_) {
     core::Box box{1.f / 8};
-    auto projection_xz =
-        collision_.project_xz(box, canonical_position_, common::kPlayerSpeed * input.xz_dv);
+    auto projection_xz = collision_.project_xz(
+        box, canonical_position_, common::kPlayerSpeed * input.xz_dv, canonical_cache_);
     canonical_position_ += common::from_xz(projection_xz, 0.f);
   }
 }
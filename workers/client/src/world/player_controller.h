@@ -1,8 +1,11 @@
 #ifndef GLOAM_WORKERS_CLIENT_SRC_WORLD_PLAYER_CONTROLLER_H
 #define GLOAM_WORKERS_CLIENT_SRC_WORLD_PLAYER_CONTROLLER_H
+#include "common/src/common/flat_map.h"
 #include "common/src/common/hashes.h"
 #include "common/src/core/collision.h"
 #include "common/src/core/tile_map.h"
+#include "common/src/managed/connection.h"
+#include "common/src/managed/task_pool.h"
 #include "workers/client/src/mode.h"
 #include "workers/client/src/world/world_renderer.h"
 #include <glm/vec2.hpp>
@@ -11,11 +14,9 @@
 #include <schema/chunk.h>
 #include <cstdint>
 #include <deque>
-#include <unordered_map>
 #include <unordered_set>
 
 namespace worker {
-class Connection;
 class Dispatcher;
 }  // ::worker
 
@@ -27,7 +28,7 @@ namespace world {
 
 class PlayerController {
 public:
-  PlayerController(worker::Connection& connection_, worker::Dispatcher& dispatcher_,
+  PlayerController(managed::Connection& connection_, worker::Dispatcher& dispatcher_,
                    const ModeState& mode_state);
 
   // Game loop functions: sync() is called at the network frame-rate; update() is called at the
@@ -35,11 +36,13 @@ public:
   void tick(const Input& input);
   void sync();
   void render(const Renderer& renderer, std::uint64_t frame) const;
+  // Adds the controller's gauges to the client's metrics.
+  void report(worker::Metrics& metrics) const;
 
 private:
   void reconcile(std::uint32_t sync_tick, const glm::vec3& coordinates);
 
-  worker::Connection& connection_;
+  managed::Connection& connection_;
   worker::Dispatcher& dispatcher_;
 
   // Player status.
@@ -63,10 +66,16 @@ private:
     std::uint8_t index = 0;
   };
   std::unordered_set<worker::EntityId> player_entities_;
-  std::unordered_map<worker::EntityId, Interpolation> interpolation_;
+  common::FlatMap<worker::EntityId, Interpolation> interpolation_;
 
   core::TileMap tile_map_;
+  // Threads for extracting collision when many chunks change at once. They sleep otherwise.
+  managed::TaskPool collision_pool_;
   core::Collision collision_;
+  // Collision caches for predicting the local position and replaying history from the canonical
+  // one, which can be some distance apart.
+  core::Collision::Cache local_cache_;
+  core::Collision::Cache canonical_cache_;
   WorldRenderer world_renderer_;
 };
 
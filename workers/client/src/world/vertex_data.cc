@@ -1,5 +1,4 @@
 #include "workers/client/src/world/vertex_data.h"
-#include "common/src/common/hashes.h"
 #include <algorithm>
 #include <cstdint>
 
@@ -36,9 +35,9 @@ float tile_material(const schema::Tile& tile) {
 
 }  // anonymous namespace
 
-glo::VertexData generate_world_data(const std::unordered_map<glm::ivec2, schema::Tile>& tile_map,
-                                    const glm::mat4& camera_matrix, bool world_pass,
-                                    float pixel_height, const glm::ivec2& antialias_level) {
+glo::VertexData generate_world_data(const core::TileMap& tile_map, const glm::mat4& camera_matrix,
+                                    bool world_pass, float pixel_height,
+                                    const glm::ivec2& antialias_level) {
   static const glm::vec3 kHalfY = {0.f, .5f, 0.f};
   std::vector<float> data;
   std::vector<GLuint> indices;
@@ -61,19 +60,20 @@ glo::VertexData generate_world_data(const std::unordered_map<glm::ivec2, schema:
     }
   };
 
-  for (const auto& pair : tile_map) {
-    const auto& coord = pair.first;
+  for (const auto& ref : tile_map.tiles()) {
+    const auto& coord = ref.coords;
+    const auto& tile = ref.tile;
     glm::vec2 min = coord;
     glm::vec2 max = coord + glm::ivec2{1, 1};
     auto mid = (min + max) / 2.f;
-    auto height = pair.second.height();
-    auto material = tile_material(pair.second);
+    auto height = tile.height();
+    auto material = tile_material(tile);
 
     glm::vec3 top_normal = {0., 1., 0.};
-    bool t_ramp = pair.second.ramp() == schema::Tile::Ramp::kUp;
-    bool b_ramp = pair.second.ramp() == schema::Tile::Ramp::kDown;
-    bool l_ramp = pair.second.ramp() == schema::Tile::Ramp::kLeft;
-    bool r_ramp = pair.second.ramp() == schema::Tile::Ramp::kRight;
+    bool t_ramp = tile.ramp() == schema::Tile::Ramp::kUp;
+    bool b_ramp = tile.ramp() == schema::Tile::Ramp::kDown;
+    bool l_ramp = tile.ramp() == schema::Tile::Ramp::kLeft;
+    bool r_ramp = tile.ramp() == schema::Tile::Ramp::kRight;
 
     if (t_ramp) {
       top_normal = glm::normalize(glm::vec3{0., 1., -1.});
@@ -86,9 +86,9 @@ glo::VertexData generate_world_data(const std::unordered_map<glm::ivec2, schema:
     }
 
     auto height_difference = [&](const glm::ivec2& v) {
-      auto it = tile_map.find(coord + v);
-      auto ramp = it == tile_map.end() ? schema::Tile::Ramp::kNone : it->second.ramp();
-      auto difference = it == tile_map.end() ? 0 : it->second.height() - height;
+      auto neighbour = tile_map.tile(coord + v);
+      auto ramp = neighbour ? neighbour->ramp() : schema::Tile::Ramp::kNone;
+      auto difference = neighbour ? neighbour->height() - height : 0;
       if ((v.x < 0 && ramp == schema::Tile::Ramp::kRight) ||
           (v.x > 0 && ramp == schema::Tile::Ramp::kLeft) ||
           (v.y < 0 && ramp == schema::Tile::Ramp::kUp) ||
@@ -99,13 +99,13 @@ glo::VertexData generate_world_data(const std::unordered_map<glm::ivec2, schema:
     };
 
     auto same_ramp = [&](const glm::ivec2& v) {
-      auto it = tile_map.find(coord + v);
-      return it != tile_map.end() && it->second.ramp() == pair.second.ramp();
+      auto neighbour = tile_map.tile(coord + v);
+      return neighbour && neighbour->ramp() == tile.ramp();
     };
 
     auto terrain_difference = [&](const glm::ivec2& v) {
-      auto it = tile_map.find(coord + v);
-      return it != tile_map.end() && it->second.terrain() != pair.second.terrain();
+      auto neighbour = tile_map.tile(coord + v);
+      return neighbour && neighbour->terrain() != tile.terrain();
     };
 
     auto l_height = height_difference(glm::ivec2{-1, 0});
@@ -212,12 +212,12 @@ glo::VertexData generate_world_data(const std::unordered_map<glm::ivec2, schema:
       index += 9;
     }
 
-    auto jt = tile_map.find(coord - glm::ivec2{0, 1});
-    if (jt != tile_map.end()) {
-      auto next_height = jt->second.height();
-      bool next_t_ramp = jt->second.ramp() == schema::Tile::Ramp::kUp;
-      bool next_l_ramp = jt->second.ramp() == schema::Tile::Ramp::kLeft;
-      bool next_r_ramp = jt->second.ramp() == schema::Tile::Ramp::kRight;
+    auto next = tile_map.tile(coord - glm::ivec2{0, 1});
+    if (next) {
+      auto next_height = next->height();
+      bool next_t_ramp = next->ramp() == schema::Tile::Ramp::kUp;
+      bool next_l_ramp = next->ramp() == schema::Tile::Ramp::kLeft;
+      bool next_r_ramp = next->ramp() == schema::Tile::Ramp::kRight;
 
       auto add_point = [&](const glm::vec3& v, const glm::vec3& n, float up_edge, float down_edge,
                            float terrain_edge) {
@@ -413,12 +413,12 @@ glo::VertexData generate_world_data(const std::unordered_map<glm::ivec2, schema:
       }
     }
 
-    jt = tile_map.find(coord - glm::ivec2{1, 0});
-    if (jt != tile_map.end()) {
-      auto next_height = jt->second.height();
-      bool next_t_ramp = jt->second.ramp() == schema::Tile::Ramp::kUp;
-      bool next_b_ramp = jt->second.ramp() == schema::Tile::Ramp::kDown;
-      bool next_r_ramp = jt->second.ramp() == schema::Tile::Ramp::kRight;
+    next = tile_map.tile(coord - glm::ivec2{1, 0});
+    if (next) {
+      auto next_height = next->height();
+      bool next_t_ramp = next->ramp() == schema::Tile::Ramp::kUp;
+      bool next_b_ramp = next->ramp() == schema::Tile::Ramp::kDown;
+      bool next_r_ramp = next->ramp() == schema::Tile::Ramp::kRight;
 
       auto add_point = [&](const glm::vec3& v, const glm::vec3& n, float up_edge, float down_edge,
                            float terrain_edge) {
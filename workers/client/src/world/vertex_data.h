@@ -1,10 +1,10 @@
 #ifndef GLOAM_WORKERS_CLIENT_SRC_WORLD_VERTEX_DATA_H
 #define GLOAM_WORKERS_CLIENT_SRC_WORLD_VERTEX_DATA_H
+#include "common/src/core/tile_map.h"
 #include "workers/client/src/glo.h"
 #include <glm/mat4x4.hpp>
 #include <glm/vec2.hpp>
 #include <schema/chunk.h>
-#include <unordered_map>
 #include <vector>
 
 namespace gloam {
@@ -16,9 +16,9 @@ const glm::vec3 kTileSize = {32, 16, 32};
 const std::int32_t kPixelLayers = 8;
 }  // anonymous namespace
 
-glo::VertexData generate_world_data(const std::unordered_map<glm::ivec2, schema::Tile>& tile_map,
-                                    const glm::mat4& camera_matrix, bool world_pass,
-                                    float pixel_height, const glm::ivec2& antialias_level);
+glo::VertexData generate_world_data(const core::TileMap& tile_map, const glm::mat4& camera_matrix,
+                                    bool world_pass, float pixel_height,
+                                    const glm::ivec2& antialias_level);
 
 glo::VertexData generate_entity_data(const std::vector<glm::vec3>& positions);
 
@@ -64,7 +64,7 @@ WorldRenderer::WorldRenderer(const ModeState& mode_state)
 void WorldRenderer::render(const Renderer& renderer, std::uint64_t frame,
                            const glm::vec3& camera_in, const std::vector<Light>& lights_in,
                            const std::vector<glm::vec3>& positions_in,
-                           const std::unordered_map<glm::ivec2, schema::Tile>& tile_map) const {
+                           const core::TileMap& tile_map) const {
   auto camera = kTileSize * camera_in;
   auto lights = lights_in;
   for (auto& light : lights) {
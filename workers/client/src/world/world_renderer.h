@@ -1,19 +1,17 @@
 #ifndef GLOAM_WORKERS_CLIENT_SRC_WORLD_WORLD_RENDERER_H
 #define GLOAM_WORKERS_CLIENT_SRC_WORLD_WORLD_RENDERER_H
-#include "common/src/common/hashes.h"
 #include "workers/client/src/glo.h"
 #include "workers/client/src/mode.h"
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <cstdint>
-#include <unordered_map>
 #include <vector>
 
 namespace gloam {
 class Renderer;
-namespace schema {
-class Tile;
-}  // ::schema
+namespace core {
+class TileMap;
+}  // ::core
 
 namespace world {
 struct Light {
@@ -27,7 +25,7 @@ public:
   WorldRenderer(const ModeState& mode_state);
   void render(const Renderer& renderer, std::uint64_t frame, const glm::vec3& camera,
               const std::vector<Light>& lights, const std::vector<glm::vec3>& positions,
-              const std::unordered_map<glm::ivec2, schema::Tile>& tile_map) const;
+              const core::TileMap& tile_map) const;
 
 private:
   void create_framebuffers(const glm::ivec2& aa_dimensions,
@@ -59,7 +59,9 @@ void ClientHandler::init(managed::ManagedConnection& c) {
       [&](const worker::CommandRequestOp<ClientHeartbeat>& op) {
         auto client = to_client(op.CallerAttributeSet);
         if (!check_client(client)) {
-          c.logger.warn("Received heartbeat from non-client " + attribute_string(client));
+          c.logger.warn(non_client_log_, [&] {
+            return "Received heartbeat from non-client " + attribute_string(client);
+          });
           return;
         }
 
@@ -69,21 +71,18 @@ void ClientHandler::init(managed::ManagedConnection& c) {
 
   c.dispatcher.OnReserveEntityIdResponse([&](const worker::ReserveEntityIdResponseOp& op) {
     Client client = {{}};
-    for (const auto& pair : clients_) {
-      if (pair.second.reserve_request_id == op.RequestId) {
-        client = pair.first;
-      }
-    }
-    if (client.attribute().empty()) {
+    auto now = std::chrono::steady_clock::now();
+    auto request_id = c.connection.request_id(op.RequestId);
+    if (!reserve_requests_.complete(request_id, op.StatusCode, now, client)) {
       return;
     }
 
     auto& info = clients_[client];
-    info.reserve_request_id.Id = 0;
     if (op.StatusCode != worker::StatusCode::kSuccess) {
-      c.logger.warn("Reserve entity ID failed for client " + attribute_string(client) +
-                    " with code " + std::to_string(static_cast<std::uint32_t>(op.StatusCode)) +
-                    ": " + op.Message);
+      c.logger.warn(reserve_failed_log_, [&] {
+        return "Reserve entity ID failed for client " + attribute_string(client) + " with code " +
+            std::to_string(static_cast<std::uint32_t>(op.StatusCode)) + ": " + op.Message;
+      });
       return;
     }
     info.entity_id = op.EntityId.value_or(-1);
@@ -91,26 +90,21 @@ void ClientHandler::init(managed::ManagedConnection& c) {
 
   c.dispatcher.OnCreateEntityResponse([&](const worker::CreateEntityResponseOp& op) {
     Client client = {{}};
-    for (const auto& pair : clients_) {
-      if (pair.second.create_request_id == op.RequestId) {
-        client = pair.first;
-      }
-    }
-    if (client.attribute().empty()) {
+    auto now = std::chrono::steady_clock::now();
+    auto request_id = c.connection.request_id(op.RequestId);
+    if (!create_requests_.complete(request_id, op.StatusCode, now, client)) {
       return;
     }
 
     auto& info = clients_[client];
-    info.create_request_id.Id = 0;
     if (op.StatusCode != worker::StatusCode::kSuccess) {
-      c.logger.warn("Create entity failed for client " + attribute_string(client) + " with code " +
-                    std::to_string(static_cast<std::uint32_t>(op.StatusCode)) + ": " + op.Message);
+      c.logger.warn(create_failed_log_, [&] {
+        return "Create entity failed for client " + attribute_string(client) + " with code " +
+            std::to_string(static_cast<std::uint32_t>(op.StatusCode)) + ": " + op.Message;
+      });
       if (op.StatusCode == worker::StatusCode::kApplicationError) {
         // Reservation expired.
         info.entity_id = -1;
-      } else {
-        // Next heartbeat will retry.
-        clients_.erase(client);
       }
       return;
     }
@@ -121,22 +115,18 @@ void ClientHandler::init(managed::ManagedConnection& c) {
 
   c.dispatcher.OnDeleteEntityResponse([&](const worker::DeleteEntityResponseOp& op) {
     Client client = {{}};
-    for (const auto& pair : clients_) {
-      if (pair.second.delete_request_id == op.RequestId) {
-        client = pair.first;
-      }
-    }
-    if (client.attribute().empty()) {
+    auto now = std::chrono::steady_clock::now();
+    auto request_id = c.connection.request_id(op.RequestId);
+    if (!delete_requests_.complete(request_id, op.StatusCode, now, client)) {
       return;
     }
 
     auto& info = clients_[client];
-    info.delete_request_id.Id = 0;
     if (op.StatusCode != worker::StatusCode::kSuccess) {
-      c.logger.warn("Delete entity failed for client " + attribute_string(client) + " with code " +
-                    std::to_string(static_cast<std::uint32_t>(op.StatusCode)) + ": " + op.Message);
-      // Wait before retrying.
-      clients_[client].timestamp_millis = timestamp_millis();
+      c.logger.warn(delete_failed_log_, [&] {
+        return "Delete entity failed for client " + attribute_string(client) + " with code " +
+            std::to_string(static_cast<std::uint32_t>(op.StatusCode)) + ": " + op.Message;
+      });
       return;
     }
     c.logger.info("Deleted entity " + std::to_string(info.entity_id) + " for " +
@@ -146,6 +136,13 @@ void ClientHandler::init(managed::ManagedConnection& c) {
   });
 }
 
+managed::Dependencies ClientHandler::dependencies() const {
+  managed::Dependencies dependencies;
+  dependencies.exclusive = false;
+  dependencies.reads = {&master_data_};
+  return dependencies;
+}
+
 void ClientHandler::sync() {
   if (!master_data_.world_spawned()) {
     return;
@@ -167,33 +164,59 @@ void ClientHandler::sync() {
     entity.Add<schema::InterpolatedPosition>({});
     entity.Add<schema::PlayerClient>({});
     entity.Add<schema::PlayerServer>({});
-    return c_->connection.SendCreateEntityRequest(entity, {entity_id}, {});
+    return c_->connection.SendCreateEntityRequest(entity, {entity_id},
+                                                  create_requests_.timeout_millis());
   };
 
+  auto now = std::chrono::steady_clock::now();
+  reserve_requests_.expire(now, [&](const Client& client) {
+    c_->logger.warn(reserve_failed_log_, [&] {
+      return "Reserve entity ID timed out for client " + attribute_string(client);
+    });
+  });
+  create_requests_.expire(now, [&](const Client& client) {
+    c_->logger.warn(create_failed_log_, [&] {
+      return "Create entity timed out for client " + attribute_string(client);
+    });
+  });
+  delete_requests_.expire(now, [&](const Client& client) {
+    c_->logger.warn(delete_failed_log_, [&] {
+      return "Delete entity timed out for client " + attribute_string(client);
+    });
+  });
+
   std::vector<Client> expired_clients;
-  auto now = timestamp_millis();
+  auto now_millis = timestamp_millis();
 
   for (auto& pair : clients_) {
     auto& info = pair.second;
-    bool expired = now - info.timestamp_millis > kDeleteEntityTimeoutMillis;
+    bool expired = now_millis - info.timestamp_millis > kDeleteEntityTimeoutMillis;
 
     // If not expired, try to create an entity.
-    if (!expired && info.entity_id < 0 && !info.reserve_request_id.Id) {
-      info.reserve_request_id = c_->connection.SendReserveEntityIdRequest({});
+    if (!expired && info.entity_id < 0 && reserve_requests_.ready(pair.first, now)) {
+      auto timeout_millis = reserve_requests_.timeout_millis();
+      reserve_requests_.sent(pair.first, c_->connection.SendReserveEntityIdRequest(timeout_millis),
+                             now);
     }
-    if (!expired && info.entity_id >= 0 && !info.entity_created && !info.create_request_id.Id) {
-      info.create_request_id = create_player_entity(pair.first, info.entity_id);
+    if (!expired && info.entity_id >= 0 && !info.entity_created &&
+        create_requests_.ready(pair.first, now)) {
+      create_requests_.sent(pair.first, create_player_entity(pair.first, info.entity_id), now);
     }
     // If expired, try to delete the entity.
-    if (expired && info.entity_created && !info.delete_request_id.Id) {
-      info.delete_request_id = c_->connection.SendDeleteEntityRequest(info.entity_id, {});
+    if (expired && info.entity_created && delete_requests_.ready(pair.first, now)) {
+      auto timeout_millis = delete_requests_.timeout_millis();
+      delete_requests_.sent(
+          pair.first, c_->connection.SendDeleteEntityRequest(info.entity_id, timeout_millis), now);
     }
-    if (expired && !info.entity_created && !info.create_request_id.Id) {
+    if (expired && !info.entity_created && !create_requests_.in_flight(pair.first)) {
       expired_clients.push_back(pair.first);
     }
   }
   for (const auto& client : expired_clients) {
     clients_.erase(client);
+    reserve_requests_.erase(client);
+    create_requests_.erase(client);
+    delete_requests_.erase(client);
   }
 }
 
@@ -2,6 +2,7 @@
 #define GLOAM_WORKERS_MASTER_SRC_CLIENT_HANDLER_H
 #include "common/src/common/hashes.h"
 #include "common/src/managed/managed.h"
+#include "common/src/managed/requests.h"
 #include <improbable/standard_library.h>
 #include <improbable/worker.h>
 #include <schema/master.h>
@@ -18,6 +19,7 @@ public:
   void init(managed::ManagedConnection& c) override;
   void tick() override {}
   void sync() override;
+  managed::Dependencies dependencies() const override;
 
 private:
   struct ClientInfo {
@@ -26,12 +28,6 @@ private:
     worker::EntityId entity_id = -1;
     // Timestamp of least heartbeat.
     std::uint64_t timestamp_millis = 0;
-    // Reserve request ID.
-    worker::RequestId<worker::ReserveEntityIdRequest> reserve_request_id;
-    // Create request ID.
-    worker::RequestId<worker::CreateEntityRequest> create_request_id;
-    // Delete request ID.
-    worker::RequestId<worker::DeleteEntityRequest> delete_request_id;
   };
 
   void update_client(const Client& client,
@@ -40,6 +36,13 @@ private:
   const schema::MasterData& master_data_;
   std::unique_ptr<managed::ManagedConnection> c_;
   std::unordered_map<Client, ClientInfo> clients_;
+  managed::RequestTracker<Client, worker::ReserveEntityIdRequest> reserve_requests_;
+  managed::RequestTracker<Client, worker::CreateEntityRequest> create_requests_;
+  managed::RequestTracker<Client, worker::DeleteEntityRequest> delete_requests_;
+  managed::LogSite non_client_log_;
+  managed::LogSite reserve_failed_log_;
+  managed::LogSite create_failed_log_;
+  managed::LogSite delete_failed_log_;
 };
 
 }  // ::master
@@ -31,6 +31,13 @@ public:
   void tick() override {}
   void sync() override {}
 
+  managed::Dependencies dependencies() const override {
+    // Only written by dispatcher callbacks.
+    managed::Dependencies dependencies;
+    dependencies.exclusive = false;
+    return dependencies;
+  }
+
 private:
   schema::MasterData data_;
 };
@@ -0,0 +1,48 @@
+#include "workers/master/src/tile_patcher.h"
+#include "common/src/common/chunk_geometry.h"
+#include <algorithm>
+
+namespace gloam {
+namespace master {
+
+TilePatcher::TilePatcher(std::int32_t chunk_size) : chunk_size_{chunk_size} {}
+
+void TilePatcher::set_tile(const glm::ivec2& coords, const schema::Tile& tile) {
+  common::ChunkGeometry<0> geometry{chunk_size_};
+  auto index = geometry.tile_index(geometry.local_coords(coords));
+  chunk_patches_[geometry.chunk_coords(coords)].emplace_back(static_cast<std::uint32_t>(index),
+                                                            tile);
+}
+
+bool TilePatcher::empty() const {
+  return chunk_patches_.empty();
+}
+
+void TilePatcher::flush(const Send& send) {
+  for (auto& pair : chunk_patches_) {
+    auto& patches = pair.second;
+    // Keep only the last edit to each tile.
+    std::stable_sort(patches.begin(), patches.end(),
+                     [](const schema::TilePatch& a, const schema::TilePatch& b) {
+                       return a.index() < b.index();
+                     });
+    worker::List<schema::TilePatch> latest;
+    for (std::size_t i = 0; i < patches.size(); ++i) {
+      if (i + 1 == patches.size() || patches[i + 1].index() != patches[i].index()) {
+        latest.push_back(patches[i]);
+      }
+    }
+    if (send(pair.first, schema::Chunk::Update{}.add_patch(schema::TilePatches{latest}))) {
+      sent_.push_back(pair.first);
+    } else {
+      patches.assign(latest.begin(), latest.end());
+    }
+  }
+  for (const auto& coords : sent_) {
+    chunk_patches_.erase(coords);
+  }
+  sent_.clear();
+}
+
+}  // ::master
+}  // ::gloam
@@ -0,0 +1,39 @@
+#ifndef GLOAM_WORKERS_MASTER_SRC_TILE_PATCHER_H
+#define GLOAM_WORKERS_MASTER_SRC_TILE_PATCHER_H
+#include "common/src/common/flat_map.h"
+#include <glm/vec2.hpp>
+#include <improbable/worker.h>
+#include <schema/chunk.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace gloam {
+namespace master {
+
+// Collects edits to individual tiles and turns them into one sparse patch event per chunk, so that
+// receivers can apply an edit without reloading the whole chunk.
+class TilePatcher {
+public:
+  // Returns false to keep the chunk's edits for the next flush.
+  using Send = std::function<bool(const glm::ivec2& chunk_coords, const schema::Chunk::Update&)>;
+  explicit TilePatcher(std::int32_t chunk_size);
+
+  // Queue an edit to the tile at the given world coordinates. Later edits to the same tile replace
+  // earlier ones.
+  void set_tile(const glm::ivec2& coords, const schema::Tile& tile);
+  bool empty() const;
+  // Calls the given function with an update for each chunk with queued edits, and clears the edits
+  // it accepted.
+  void flush(const Send& send);
+
+private:
+  std::int32_t chunk_size_;
+  common::FlatMap<glm::ivec2, std::vector<schema::TilePatch>> chunk_patches_;
+  std::vector<glm::ivec2> sent_;
+};
+
+}  // ::master
+}  // ::gloam
+
+#endif
@@ -1,8 +1,11 @@
 #include "workers/master/src/world_spawner.h"
 #include "common/src/common/definitions.h"
+#include "common/src/common/update_merge.h"
+#include "common/src/core/tile_codec.h"
 #include <improbable/worker.h>
 #include <schema/chunk.h>
 #include <schema/common.h>
+#include <chrono>
 #include <unordered_set>
 
 namespace gloam {
@@ -11,6 +14,13 @@ namespace {
 const std::string kChunkSizeFlag = "chunk_size";
 const std::int32_t kChunkSizeDefault = 8;
 const std::int32_t kWorldSize = 4;
+// Edited chunks are written back once they've gone this long without an edit, or at the latest
+// this long after the first edit that hasn't been written back.
+const std::chrono::seconds kPersistDelay{5};
+const std::chrono::seconds kMaxPersistDelay{60};
+// The master writes tile edits back into chunks, so it needs to be able to read them too.
+const improbable::WorkerRequirementSet kChunkReadSet = {
+    {{{common::kAmbientAttribute}}, {{common::kClientAttribute}}, {{common::kMasterAttribute}}}};
 
 std::string coords_string(const glm::ivec2& coords) {
   return "(" + std::to_string(coords.x) + ", " + std::to_string(coords.y) + ")";
@@ -29,6 +39,7 @@ void WorldSpawner::init(managed::ManagedConnection& c) {
   } else {
     chunk_size_ = kChunkSizeDefault;
   }
+  tile_patcher_.reset(new TilePatcher{chunk_size_});
 
   c.dispatcher.OnAuthorityChange<schema::Master>([&](const worker::AuthorityChangeOp& op) {
     if (op.Authority == worker::Authority::kAuthoritative && !master_data_.world_spawned()) {
@@ -44,24 +55,41 @@ void WorldSpawner::init(managed::ManagedConnection& c) {
     }
   });
 
+  c.dispatcher.OnAddComponent<schema::Chunk>(
+      [&](const worker::AddComponentOp<schema::Chunk>& op) {
+        const auto& data = op.Data;
+        if (data.chunk_size() != chunk_size_) {
+          return;
+        }
+        worker::List<schema::Tile> tiles;
+        if (data.packed_tiles().empty()) {
+          tiles = data.tiles();
+        } else if (!core::decode_tiles(data.packed_tiles(),
+                                       static_cast<std::size_t>(chunk_size_ * chunk_size_),
+                                       tiles)) {
+          return;
+        }
+        auto& chunk = chunk_tiles_[{data.chunk_x(), data.chunk_y()}];
+        // Our own copy is newer if it has edits that haven't been written back yet.
+        if (!chunk.dirty) {
+          chunk.tiles = std::move(tiles);
+        }
+      });
+
   c.dispatcher.OnReserveEntityIdResponse([&](const worker::ReserveEntityIdResponseOp& op) {
     glm::ivec2 coords;
-    bool found = false;
-    for (const auto& pair : chunks_) {
-      if (pair.second.reserve_request_id == op.RequestId) {
-        coords = pair.first;
-        found = true;
-      }
-    }
-    if (!found) {
+    auto now = std::chrono::steady_clock::now();
+    auto request_id = c.connection.request_id(op.RequestId);
+    if (!reserve_requests_.complete(request_id, op.StatusCode, now, coords)) {
       return;
     }
 
     auto& info = chunks_[coords];
-    info.reserve_request_id.Id = 0;
     if (op.StatusCode != worker::StatusCode::kSuccess) {
-      c.logger.warn("Reserve entity ID failed for chunk " + coords_string(coords) + " with code " +
-                    std::to_string(static_cast<std::uint32_t>(op.StatusCode)) + ": " + op.Message);
+      c.logger.warn(reserve_failed_log_, [&] {
+        return "Reserve entity ID failed for chunk " + coords_string(coords) + " with code " +
+            std::to_string(static_cast<std::uint32_t>(op.StatusCode)) + ": " + op.Message;
+      });
       return;
     }
     info.entity_id = op.EntityId.value_or(-1);
@@ -69,33 +97,46 @@ void WorldSpawner::init(managed::ManagedConnection& c) {
 
   c.dispatcher.OnCreateEntityResponse([&](const worker::CreateEntityResponseOp& op) {
     glm::ivec2 coords;
-    bool found = false;
-    for (const auto& pair : chunks_) {
-      if (pair.second.create_request_id == op.RequestId) {
-        coords = pair.first;
-        found = true;
-      }
-    }
-    if (!found) {
+    auto now = std::chrono::steady_clock::now();
+    auto request_id = c.connection.request_id(op.RequestId);
+    if (!create_requests_.complete(request_id, op.StatusCode, now, coords)) {
       return;
     }
 
     auto& info = chunks_[coords];
-    info.create_request_id.Id = 0;
     if (op.StatusCode != worker::StatusCode::kSuccess) {
-      c.logger.warn("Create entity failed for chunk " + coords_string(coords) + " with code " +
-                    std::to_string(static_cast<std::uint32_t>(op.StatusCode)) + ": " + op.Message);
+      c.logger.warn(create_failed_log_, [&] {
+        return "Create entity failed for chunk " + coords_string(coords) + " with code " +
+            std::to_string(static_cast<std::uint32_t>(op.StatusCode)) + ": " + op.Message;
+      });
       if (op.StatusCode == worker::StatusCode::kApplicationError) {
         // Reservation expired.
         info.entity_id = -1;
       }
-      // TODO: should probably have a timeout otherwise.
       return;
     }
     info.entity_created = true;
   });
 }
 
+void WorldSpawner::set_tile(const glm::ivec2& coords, const schema::Tile& tile) {
+  if (!core::can_encode(tile)) {
+    c_->logger.error(dropped_edit_log_, [&] {
+      return "Dropped edit to tile " + coords_string(coords) + " that can't be encoded";
+    });
+    return;
+  }
+  std::lock_guard<std::mutex> lock{tile_patcher_mutex_};
+  tile_patcher_->set_tile(coords, tile);
+}
+
+managed::Dependencies WorldSpawner::dependencies() const {
+  managed::Dependencies dependencies;
+  dependencies.exclusive = false;
+  dependencies.reads = {&master_data_};
+  return dependencies;
+}
+
 void WorldSpawner::sync() {
   std::unordered_set<glm::ivec2> chunks_stored;
   for (const auto& info : master_data_.chunks()) {
@@ -105,10 +146,14 @@ void WorldSpawner::sync() {
     chunks_stored.insert(coord);
   }
 
-  auto create_chunk_entity = [&](const glm::ivec2& coords, worker::EntityId entity_id) {
-    improbable::EntityAclData entity_acl{common::kAllWorkersSet, {}};
+  // Returns false, without sending anything, if the chunk can't be created.
+  auto create_chunk_entity = [&](const glm::ivec2& coords, worker::EntityId entity_id,
+                                 worker::RequestId<worker::CreateEntityRequest>& request_id)
+      -> bool {
+    improbable::EntityAclData entity_acl{kChunkReadSet,
+                                         {{schema::Chunk::ComponentId, common::kMasterOnlySet}}};
 
-    schema::ChunkData chunk_data{chunk_size_, coords.x, coords.y, {}};
+    worker::List<schema::Tile> tiles;
     for (std::int32_t y = 0; y < chunk_size_; ++y) {
       for (std::int32_t x = 0; x < chunk_size_; ++x) {
         auto cs2 = chunk_size_ / 2;
@@ -120,7 +165,7 @@ void WorldSpawner::sync() {
                     ? schema::Tile::Ramp::kLeft
                     : (x == cs2 || 1 + x == cs2) && 2 + y == cs2 ? schema::Tile::Ramp::kLeft
                                                                  : schema::Tile::Ramp::kNone;
-        chunk_data.tiles().emplace_back(
+        tiles.emplace_back(
             schema::Tile::Terrain::kGrass, (!x && !y) || (x == cs2 && (y == cs2 || 1 + y == cs2))
                 ? 2
                 : (x - 1 == cs2 || 2 + x == cs2 || 1 + x == cs2) && (y == cs2 || 1 + y == cs2) ? 1
@@ -128,6 +173,14 @@ void WorldSpawner::sync() {
             ramp);
       }
     }
+    // Only send the packed encoding; the tiles list is left empty.
+    std::string packed_tiles;
+    if (!core::encode_tiles(tiles, packed_tiles)) {
+      c_->logger.fatal("Generated tiles for chunk " + coords_string(coords) + " can't be encoded");
+      return false;
+    }
+    schema::ChunkData chunk_data{chunk_size_, coords.x, coords.y, {}, packed_tiles};
+    chunk_tiles_[coords].tiles = tiles;
 
     auto chunk_size = static_cast<double>(chunk_size_);
     worker::Entity entity;
@@ -137,29 +190,105 @@ void WorldSpawner::sync() {
     entity.Add<improbable::Persistence>({});
     entity.Add<improbable::Position>(
         {{chunk_size / 2 + coords.x * chunk_size, 0., chunk_size / 2 + coords.y * chunk_size}});
-    return c_->connection.SendCreateEntityRequest(entity, {entity_id}, {});
+    request_id = c_->connection.SendCreateEntityRequest(entity, {entity_id},
+                                                        create_requests_.timeout_millis());
+    return true;
   };
 
+  auto now = std::chrono::steady_clock::now();
+  reserve_requests_.expire(now, [&](const glm::ivec2& coords) {
+    c_->logger.warn(reserve_failed_log_, [&] {
+      return "Reserve entity ID timed out for chunk " + coords_string(coords);
+    });
+  });
+  create_requests_.expire(now, [&](const glm::ivec2& coords) {
+    c_->logger.warn(create_failed_log_, [&] {
+      return "Create entity timed out for chunk " + coords_string(coords);
+    });
+  });
+
   worker::List<schema::ChunkInfo> chunks_spawned;
   for (auto& pair : chunks_) {
     auto& info = pair.second;
 
-    if (info.entity_id < 0 && !info.reserve_request_id.Id) {
-      info.reserve_request_id = c_->connection.SendReserveEntityIdRequest({});
+    if (info.entity_id < 0 && reserve_requests_.ready(pair.first, now)) {
+      auto timeout_millis = reserve_requests_.timeout_millis();
+      reserve_requests_.sent(pair.first, c_->connection.SendReserveEntityIdRequest(timeout_millis),
+                             now);
     }
-    if (info.entity_id >= 0 && !info.entity_created && !info.create_request_id.Id) {
-      info.create_request_id = create_chunk_entity(pair.first, info.entity_id);
+    if (info.entity_id >= 0 && !info.entity_created && create_requests_.ready(pair.first, now)) {
+      worker::RequestId<worker::CreateEntityRequest> request_id;
+      if (create_chunk_entity(pair.first, info.entity_id, request_id)) {
+        create_requests_.sent(pair.first, request_id, now);
+      }
     }
     if (info.entity_id >= 0 && info.entity_created) {
       chunks_spawned.emplace_back(info.entity_id, pair.first.x, pair.first.y);
     }
   }
 
+  // Patches go out as soon as their chunk's entity exists. Events aren't persisted, so the patched
+  // tiles are written back too, but only once the chunk has settled and in an update of their own:
+  // receivers that have applied the patches then find nothing to reload.
+  {
+    std::lock_guard<std::mutex> lock{tile_patcher_mutex_};
+    tile_patcher_->flush([&](const glm::ivec2& coords, const schema::Chunk::Update& patch) {
+      auto it = chunks_.find(coords);
+      auto tiles_it = chunk_tiles_.find(coords);
+      if (it == chunks_.end() || !it->second.entity_created || tiles_it == chunk_tiles_.end()) {
+        if (it != chunks_.end() || !master_data_.world_spawned()) {
+          // Keep the edits until the chunk's entity exists and has been checked out.
+          return false;
+        }
+        c_->logger.error(dropped_edit_log_, [&] {
+          return "Dropped edits to chunk " + coords_string(coords) + " outside the world";
+        });
+        return true;
+      }
+      auto& chunk = tiles_it->second;
+      for (const auto& patches : patch.patch()) {
+        for (const auto& tile_patch : patches.patches()) {
+          if (tile_patch.index() < chunk.tiles.size()) {
+            chunk.tiles[tile_patch.index()] = tile_patch.tile();
+          }
+        }
+      }
+      if (!chunk.dirty) {
+        chunk.dirty = true;
+        chunk.first_edit = now;
+        dirty_chunks_.push_back(coords);
+      }
+      chunk.last_edit = now;
+      c_->updates.SendComponentUpdate<schema::Chunk>(it->second.entity_id, patch);
+      return true;
+    });
+  }
+  // A chunk still being edited at the latest deadline is written back in the same frame as its
+  // patches, which the update buffer merges into a reload; that's rare enough not to matter.
+  for (std::size_t i = 0; i < dirty_chunks_.size();) {
+    auto coords = dirty_chunks_[i];
+    auto& chunk = chunk_tiles_[coords];
+    if (now - chunk.last_edit < kPersistDelay && now - chunk.first_edit < kMaxPersistDelay) {
+      ++i;
+      continue;
+    }
+    dirty_chunks_[i] = dirty_chunks_.back();
+    dirty_chunks_.pop_back();
+    chunk.dirty = false;
+    std::string packed_tiles;
+    if (!core::encode_tiles(chunk.tiles, packed_tiles)) {
+      c_->logger.error("Tiles of chunk " + coords_string(coords) + " can't be encoded");
+      continue;
+    }
+    c_->updates.SendComponentUpdate<schema::Chunk>(
+        chunks_[coords].entity_id, schema::Chunk::Update{}.set_packed_tiles(packed_tiles));
+  }
+
   if (chunks_spawned.size() != chunks_stored.size()) {
     schema::Master::Update update;
     update.set_world_spawned(chunks_spawned.size() == chunks_.size());
     update.set_chunks(chunks_spawned);
-    c_->connection.SendComponentUpdate<schema::Master>(0, update);
+    c_->updates.SendComponentUpdate<schema::Master>(0, update);
   }
 }
 
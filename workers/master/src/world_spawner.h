@@ -1,11 +1,15 @@
 #ifndef GLOAM_WORKERS_MASTER_SRC_WORLD_SPAWNER_H
 #define GLOAM_WORKERS_MASTER_SRC_WORLD_SPAWNER_H
-#include "common/src/common/hashes.h"
+#include "common/src/common/flat_map.h"
 #include "common/src/managed/managed.h"
+#include "common/src/managed/requests.h"
+#include "workers/master/src/tile_patcher.h"
 #include <glm/vec2.hpp>
 #include <improbable/worker.h>
 #include <schema/master.h>
-#include <unordered_map>
+#include <chrono>
+#include <mutex>
+#include <vector>
 
 namespace gloam {
 namespace master {
@@ -16,22 +20,45 @@ public:
   void init(managed::ManagedConnection& c) override;
   void tick() override {}
   void sync() override;
+  managed::Dependencies dependencies() const override;
+
+  // Edit a single tile of the world. Can be called from any thread. Edits are sent as a patch event
+  // on the next sync once the chunk's entity exists and has been checked out, and written back
+  // into the chunk's packed tiles once the chunk has stopped changing. Edits to tiles outside the
+  // world, or that can't be encoded, are dropped with an error.
+  void set_tile(const glm::ivec2& coords, const schema::Tile& tile);
 
 private:
   struct ChunkInfo {
     bool entity_created = false;
     // Entity ID for this chunk.
     worker::EntityId entity_id = -1;
-    // Reserve request ID.
-    worker::RequestId<worker::ReserveEntityIdRequest> reserve_request_id;
-    // Create request ID.
-    worker::RequestId<worker::CreateEntityRequest> create_request_id;
+  };
+
+  struct ChunkTiles {
+    worker::List<schema::Tile> tiles;
+    // Whether there are edits not yet written back into the chunk's packed tiles, and when the
+    // first and last of them were sent.
+    bool dirty = false;
+    std::chrono::steady_clock::time_point first_edit;
+    std::chrono::steady_clock::time_point last_edit;
   };
 
   const schema::MasterData& master_data_;
   std::int32_t chunk_size_;
   std::unique_ptr<managed::ManagedConnection> c_;
-  std::unordered_map<glm::ivec2, ChunkInfo> chunks_;
+  // Guards tile_patcher_, since set_tile() can be called while sync() is running.
+  std::mutex tile_patcher_mutex_;
+  std::unique_ptr<TilePatcher> tile_patcher_;
+  // Current tiles of each chunk, as created or checked out, with edits applied.
+  common::FlatMap<glm::ivec2, ChunkTiles> chunk_tiles_;
+  std::vector<glm::ivec2> dirty_chunks_;
+  common::FlatMap<glm::ivec2, ChunkInfo> chunks_;
+  managed::RequestTracker<glm::ivec2, worker::ReserveEntityIdRequest> reserve_requests_;
+  managed::RequestTracker<glm::ivec2, worker::CreateEntityRequest> create_requests_;
+  managed::LogSite reserve_failed_log_;
+  managed::LogSite create_failed_log_;
+  managed::LogSite dropped_edit_log_;
 };
 
 }  // ::master
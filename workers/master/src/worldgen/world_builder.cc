@@ -1,6 +1,6 @@
 #include "world_builder.h"
+#include "common/src/common/chunk_geometry.h"
 #include "common/src/common/hashes.h"
-#include "common/src/common/math.h"
 #include "map_builder.h"
 #include <schema/chunk.h>
 #include <unordered_set>
@@ -33,12 +33,11 @@ WorldBuilder::WorldBuilder(WorldType type) : type_{type} {}
 std::vector<glm::ivec2> WorldBuilder::get_chunks(std::int32_t chunk_size) const {
   std::unordered_set<glm::ivec2> result;
   for (const auto& map : maps_) {
-    auto min = map.origin;
-    auto max = map.origin + map.builder->data().dimensions;
-    for (auto y = common::euclidean_div(min.y, chunk_size);
-         y <= common::euclidean_div(max.y - 1, chunk_size); ++y) {
-      for (auto x = common::euclidean_div(min.x, chunk_size);
-           x <= common::euclidean_div(max.x - 1, chunk_size); ++x) {
+    auto min = common::chunk_coords(chunk_size, map.origin);
+    auto max = common::chunk_coords(
+        chunk_size, map.origin + map.builder->data().dimensions - glm::ivec2{1, 1});
+    for (auto y = min.y; y <= max.y; ++y) {
+      for (auto x = min.x; x <= max.x; ++x) {
         result.insert({x, y});
       }
     }
@@ -48,7 +47,7 @@ std::vector<glm::ivec2> WorldBuilder::get_chunks(std::int32_t chunk_size) const
 
 schema::ChunkData WorldBuilder::get_chunk_data(std::int32_t chunk_size,
                                                const glm::ivec2& chunk) const {
-  schema::ChunkData data{chunk_size, chunk.x, chunk.y, {}};
+  schema::ChunkData data{chunk_size, chunk.x, chunk.y, {}, {}};
   return data;
 }
 